@@ -1,48 +1,125 @@
 #include "nesproj.h"
+#include "netsync.h"
+#include "otaload.h"
+#include "linkstats.h"
+#include "trace.h"
+#include "command.h"
+#include "history.h"
+#include "hvac.h"
+#include "liveness.h"
+#include "binlog.h"
+#include "inflight.h"
+#include "scene.h"
+#include "param.h"
+#include "impair.h"
+#include "wakes.h"
+#include "persist.h"
+#if CU_COAP
+#include "cucoap.h"
+#endif
+#include "dev/serial-line.h"
 #include "string.h"
 #include "sys/stimer.h"
 #include "sys/etimer.h"
+#include "sys/ctimer.h"
 #include "stdarg.h"
 
-// Wait for command period and the maximum number the user can press the button for
-#define CMD_PERIOD  CLOCK_SECOND*4
+// The maximum number the user can press the button for. How long a command
+// is waited for and a result is shown are runtime parameters (param.h)
 #define MAX_BUTTON_PRESS    COMMAND_NUMBER
-#define MONITOR_PAUSE   CLOCK_SECOND*2
 #define GATE_ACK_MASK   0x02
 #define DOOR_ACK_MASK   0x01
 #define ALL_ACK_MASK    (GATE_ACK_MASK | DOOR_ACK_MASK)
 
+// Commands carry their target state and a sequence number, the actuators drop
+// the duplicates so it is safe to retransmit often while waiting for the acks.
+// They are sent again up to PARAM_CMD_RETX times
+#define CMD_RETX_PERIOD (CLOCK_SECOND >> 2)
+
+// Scenes of the menu (commands 7 and 8), they can be programmed with
+// "scene <n> <actions>" on the serial line. The reports of the actuators are
+// waited for at most an opening and closing of the entrance, from the start
+// time of the scene and with the longest open time of the nodes, plus a
+// margin for the reports to come back
+#define SCENE_NUM       2
+#define SCENE_MARGIN    (CLOCK_SECOND * 10)
+
+// Default window of the history queries, seconds
+#define HISTORY_WINDOW  3600UL
+
+// Alarm acknowledgments and temperature alerts bypass the event queue: the
+// receive callbacks put them here and poll the alarm lane, which Contiki runs
+// before dispatching the next event
+#define ALARM_LANE_LEN  4
+
+// The other frames of the nodes are copied here by the receive callbacks
+// and posted to msg_process, which takes them in order. A power of two
+#define RX_QUEUE_LEN    8
+
 // Checking if a message is from door or gate node
 #define IS_FROM_DOOR() last_sender[0] == DOOR_ADDR_0 && last_sender[1] == DOOR_ADDR_1
 #define IS_FROM_GATE() last_sender[0] == GATE_ADDR_0 && last_sender[1] == GATE_ADDR_1
 
 // Rime address for this node
 linkaddr_t cu_addr = {{CU_ADDR_0, CU_ADDR_1}};
+linkaddr_t door_addr = {{DOOR_ADDR_0, DOOR_ADDR_1}};
 uint8_t last_sender[2];
 
-PROCESS(button_process, "Central Unit Button Process");
-PROCESS(main_process, "Central Unit Main Process");
-PROCESS(msg_process, "Central Unit Message Manager");
+// msg_process dispatches the button, the serial line and the messages of the
+// nodes; the UI and the button timing are functions and ctimer callbacks run
+// in its context. The monitor and the alarm lane stay processes of their own
+// since they are polled, and polls run ahead of the event queue
+PROCESS(msg_process, "Central Unit Dispatcher");
 PROCESS(monitor_process, "Central Unit Monitor Manager");
-
-AUTOSTART_PROCESSES(&main_process, &button_process, &monitor_process, &msg_process);
+PROCESS(alarm_lane_process, "Central Unit Alarm Lane");
+
+// The alarm lane is started last so it comes first in the process list, and
+// it is run before the other polled processes (the monitor)
+AUTOSTART_PROCESSES(&monitor_process, &msg_process, &alarm_lane_process);
+
+// Stress mode: instead of waiting for the button, the CU issues CU_STRESS_RATE
+// requests per second to the CU_STRESS_NODES actuators of a synthetic
+// topology and periodically prints throughput, success ratio and latency.
+// Actuator addresses go from 1 skipping the CU one, odd addresses are Door
+// style nodes and even addresses Gate style ones. See tools/gen-topology.py
+#ifndef CU_STRESS
+#define CU_STRESS   0
+#endif
+#if CU_STRESS
+#ifndef CU_STRESS_RATE
+#define CU_STRESS_RATE  2
+#endif
+#ifndef CU_STRESS_NODES
+#define CU_STRESS_NODES 2
+#endif
+#define STRESS_REPORT_PERIOD    (CLOCK_SECOND * 10)
+#define STRESS_WINDOW   16
+#endif
 
 // Custom events this node has to manage
-static process_event_t valid_cmd_ev;
 static process_event_t sensor_msg_ev;
-static process_event_t update_monitor_ev;
-static process_event_t update_state_ev;
+static process_event_t setpoint_ev;
+static process_event_t scene_ev;
 
 // Node state and command to issue
 enum user_command cmd_issued;
 enum alarm_state alarm_state;
 enum entrance_state entrance_state;
 enum lock_state gate_lock_state;
+enum onoff_state hvac_state;
+int hvac_setpoint;
+clock_time_t hvac_time;
 
-// light and temperature
+// light and temperature, the latter in hundredths of degree
 int light;
 int temperature;
 
+// Network time the nodes have sent the last light and temperature
+clock_time_t light_time;
+clock_time_t temperature_time;
+int alert_temperature;
+clock_time_t alert_time;
+
 // Message for updating the UI
 enum monitor_message {
     PRINT_ISSUED_COMMAND,
@@ -61,20 +138,283 @@ enum monitor_message {
     PRINT_LOCKED_GATE,
     PRINT_ENTRANCE_OPEN,
     PRINT_ENTRANCE_CLOSED,
-    PRINT_LIGHT_REQUESTED
+    PRINT_LIGHT_REQUESTED,
+    PRINT_HVAC,
+    PRINT_HVAC_SETPOINT,
+    PRINT_TEMP_ALERT,
+    PRINT_LIVENESS,
+    PRINT_SCENE,
+    PRINT_MSG_NUM
 };
 
+// Monitor updates waiting to be printed, one bit for each monitor_message.
+// Repeated updates are merged and monitor_process is polled instead of being
+// posted an event, so the event queue doesn't grow with the updates
+#define MONITOR_BIT(m)  ((uint32_t) 1 << (m))
+static uint32_t monitor_dirty = 0;
+
+// Events lost because the event queue was full
+static uint16_t queue_full_count = 0;
+
+void monitor_notify (enum monitor_message mon_msg){
+    monitor_dirty |= MONITOR_BIT(mon_msg);
+    process_poll(&monitor_process);
+#if CU_COAP
+    // Whatever else is shown may be a change of the state, cucoap drops the
+    // notifications that change nothing
+    if (mon_msg == PRINT_TEMP){
+        cucoap_changed(CUCOAP_TEMP);
+    }
+    else if (mon_msg == PRINT_LIGHT){
+        cucoap_changed(CUCOAP_LIGHT);
+    }
+    else {
+        cucoap_changed(CUCOAP_STATE);
+    }
+#endif
+}
+
+static void queue_full (process_event_t ev){
+    ++queue_full_count;
+    BINLOG(LOG_QUEUE_FULL, ev, queue_full_count);
+    monitor_notify(PRINT_FULL_QUEUE);
+}
+
+bool post_event (struct process* p, process_event_t ev, process_data_t data){
+    if (process_post(p, ev, data) != PROCESS_ERR_OK){
+        queue_full(ev);
+        return false;
+    }
+    return true;
+}
+
+// Readings are kept with the CU clock in seconds, the network time stamps of
+// the nodes wrap too often for hours of history
+void history_record (const linkaddr_t* from, const msg_t* msg){
+    struct history* h;
+
+    // The Door has not filled its window yet
+    if (msg->hdr == TEMP_MSG && msg->payload == (uint16_t) INT_MIN){
+        return;
+    }
+    h = history_series(from, msg->hdr);
+    if (h != NULL){
+        history_append(h, clock_seconds(), (int16_t) msg->payload);
+    }
+}
+
+// "history temp|light|alert [seconds]" on the serial line, last hour by default
+void history_print (const char* args){
+    struct history_stats stats;
+    struct history* h;
+    unsigned long now = clock_seconds();
+    unsigned long window = HISTORY_WINDOW;
+    const char* arg;
+    const char* name;
+    uint8_t sensor;
+    uint8_t i;
+
+    if (strncmp(args, "temp", 4) == 0){
+        sensor = TEMP_MSG;
+        name = "temp";
+    }
+    else if (strncmp(args, "light", 5) == 0){
+        sensor = LIGHT_MSG;
+        name = "light";
+    }
+    else if (strncmp(args, "alert", 5) == 0){
+        sensor = ALERT_MSG;
+        name = "alert";
+    }
+    else {
+        printf("usage: history temp|light|alert [seconds]\n");
+        return;
+    }
+    arg = strchr(args, ' ');
+    if (arg != NULL && atol(arg + 1) > 0){
+        window = atol(arg + 1);
+    }
+
+    for (i = 0; i < HISTORY_SERIES; ++i){
+        h = history_get(i);
+        if (h == NULL || h->sensor != sensor){
+            continue;
+        }
+        if (history_query(h, (now > window) ? now - window : 0, now, &stats)){
+            printf("History %d.%d %s last %lus: %u readings, min %d, max %d, avg %d\n",
+                   h->node.u8[0], h->node.u8[1], name, window, stats.count,
+                   stats.min, stats.max, stats.avg);
+        }
+        else {
+            printf("History %d.%d %s last %lus: no readings\n",
+                   h->node.u8[0], h->node.u8[1], name, window);
+        }
+    }
+}
+
+// Last command sent, it is retransmitted with the same seq until it is
+// acknowledged or the retransmission budget is exhausted
+static msg_t pending_cmd;
+static linkaddr_t pending_dest;
+static uint8_t pending_retx;
+static bool cmd_pending = false;
+static uint8_t cmd_seq = 0;
+static struct etimer retx_timer;
+
+// Scenes, and the one sent last with the reports received so far
+static uint16_t scenes[SCENE_NUM] = {
+    SCENE_PACK(ENTRANCE_CLOSE, GATE_LOCK, ALARM_ENABLED, HVAC_OFF),
+    SCENE_PACK(ALARM_DISABLED, GATE_UNLOCK, ENTRANCE_OPEN, HVAC_ON)
+};
+static uint8_t scene_sent;
+static uint16_t scene_steps;
+static uint8_t scene_seq;
+static uint16_t scene_result;
+static uint8_t scene_reports = 0x0;
+// Open time of the Door and of the Gate, as last read from them
+static int16_t open_seconds[2];
+
+// Parameter request sent last, the reply is matched by its seq
+static uint8_t param_seq = 0;
+static uint8_t param_node;
+static uint8_t param_id;
+
+struct lane_entry {
+    linkaddr_t from;
+    msg_t msg;
+    rtimer_clock_t received;
+};
+
+static struct lane_entry alarm_lane[ALARM_LANE_LEN];
+static uint8_t lane_head = 0;
+static uint8_t lane_tail = 0;
+
+// Free running indexes, head - tail frames are posted and not yet taken
+static struct lane_entry rx_queue[RX_QUEUE_LEN];
+static uint8_t rx_head = 0;
+static uint8_t rx_tail = 0;
+static uint8_t alarm_acks = 0x0;
+
+// Time from the reception of an alarm frame to the state update, and longest
+// monitor step, the bound of that time under UI load
+static rtimer_clock_t lane_latency_max = 0;
+static uint32_t lane_latency_sum = 0;
+static uint16_t lane_frames = 0;
+static rtimer_clock_t monitor_step_max = 0;
+
+static bool is_alarm_frame (const msg_t* msg){
+    return msg->hdr == ALERT_MSG ||
+           (msg->hdr == CMD_MSG && (msg->payload == ALARM_ENABLED ||
+                                    msg->payload == ALARM_DISABLED ||
+                                    msg->payload == ALARM_ENABLING));
+}
+
+// Returns false if the frame has to go through the event queue, because it
+// isn't an alarm frame or the lane is full
+bool alarm_lane_push (const linkaddr_t* from, const void* data){
+    struct lane_entry* e = &alarm_lane[lane_head];
+    uint8_t next = (lane_head + 1) % ALARM_LANE_LEN;
+
+    memcpy(&e->msg, data, sizeof(msg_t));
+    if (!is_alarm_frame(&e->msg) || next == lane_tail){
+        return false;
+    }
+    linkaddr_copy(&e->from, from);
+    e->received = RTIMER_NOW();
+    lane_head = next;
+    process_poll(&alarm_lane_process);
+    return true;
+}
+
+void alarm_lane_apply (const struct lane_entry* e){
+    rtimer_clock_t latency;
+
+    // Every frame of the lane is measured, a partial ack included
+    latency = RTIMER_NOW() - e->received;
+    if (latency > lane_latency_max){
+        lane_latency_max = latency;
+    }
+    lane_latency_sum += latency;
+    ++lane_frames;
+
+    if (e->msg.hdr == ALERT_MSG){
+        alert_temperature = (int16_t) e->msg.payload;
+        alert_time = e->msg.time;
+        history_record(&e->from, &e->msg);
+        monitor_notify(PRINT_TEMP_ALERT);
+    }
+    else if (e->msg.payload == ALARM_ENABLING){
+        alarm_state = ENABLING;
+        monitor_notify(PRINT_ALARM_ENABLING);
+    }
+    else {
+        // The alarm changes once both actuators have acknowledged it
+        if (linkaddr_cmp(&e->from, &door_addr)){
+            alarm_acks |= DOOR_ACK_MASK;
+        }
+        if (e->from.u8[0] == GATE_ADDR_0 && e->from.u8[1] == GATE_ADDR_1){
+            alarm_acks |= GATE_ACK_MASK;
+        }
+        if (alarm_acks != ALL_ACK_MASK){
+            return;
+        }
+        alarm_acks = 0x0;
+        cmd_pending = false;
+        alarm_state = (e->msg.payload == ALARM_ENABLED) ? ENABLED : DISABLED;
+        monitor_notify((alarm_state == ENABLED) ? PRINT_ALARM_ACTIVE : PRINT_ALARM_DISABLED);
+    }
+    monitor_notify(PRINT_MENU);
+}
+
+// "latency" on the serial line
+void alarm_lane_print (){
+    printf("Alarm lane: %u frames, max %lu ms, avg %lu ms, longest monitor step %lu ms\n",
+           lane_frames, (unsigned long) lane_latency_max * 1000 / RTIMER_SECOND,
+           lane_frames ? lane_latency_sum / lane_frames * 1000 / RTIMER_SECOND : 0UL,
+           (unsigned long) monitor_step_max * 1000 / RTIMER_SECOND);
+}
+
+// A frame for msg_process, lost as an event would be if there is no room
+static void rx_post (const linkaddr_t* from, const void* data){
+    struct lane_entry* e;
+
+    if ((uint8_t) (rx_head - rx_tail) == RX_QUEUE_LEN){
+        queue_full(sensor_msg_ev);
+        return;
+    }
+    e = &rx_queue[rx_head % RX_QUEUE_LEN];
+    linkaddr_copy(&e->from, from);
+    memcpy(&e->msg, data, sizeof(msg_t));
+    e->received = RTIMER_NOW();
+    if (post_event(&msg_process, sensor_msg_ev, e)){
+        ++rx_head;
+    }
+}
+
 //Definition of the receiving & sending callback functions
 static void broadcast_recv (struct broadcast_conn *c, const linkaddr_t *from){
-	last_sender[0] = (uint8_t) from->u8[0];
-	last_sender[1] = (uint8_t) from->u8[1];
-	process_post(NULL, sensor_msg_ev, packetbuf_dataptr());
+	TRACE_RX(BC_CH, from);
+	link_stats_rx(from);
+	link_stats_beacon(from);
+	if (liveness_seen(from)){
+		monitor_notify(PRINT_LIVENESS);
+	}
+	if (alarm_lane_push(from, packetbuf_dataptr())){
+		return;
+	}
+	rx_post(from, packetbuf_dataptr());
 }
 
 static void runicast_recv (struct runicast_conn *c, const linkaddr_t *from, uint8_t seqno){
-    last_sender[0] = (uint8_t) from->u8[0];
-    last_sender[1] = (uint8_t) from->u8[1];
-    process_post(NULL, sensor_msg_ev, packetbuf_dataptr());
+    TRACE_RX(RU_CH, from);
+    link_stats_rx(from);
+    if (liveness_seen(from)){
+        monitor_notify(PRINT_LIVENESS);
+    }
+    if (alarm_lane_push(from, packetbuf_dataptr())){
+        return;
+    }
+    rx_post(from, packetbuf_dataptr());
 }
 
 static void broadcast_sent( struct broadcast_conn *c, int status, int num_tx){
@@ -82,11 +422,18 @@ static void broadcast_sent( struct broadcast_conn *c, int status, int num_tx){
 }
 
 static void runicast_sent (struct runicast_conn *c, const linkaddr_t *to, uint8_t retransmissions){
-	// Do nothing
+	link_stats_tx(to, retransmissions, true);
+	if (liveness_seen(to)){
+		monitor_notify(PRINT_LIVENESS);
+	}
 }
 
 static void runicast_timedout (struct runicast_conn *c, const linkaddr_t *to, uint8_t retransmissions){
-	// Do nothing
+	link_stats_tx(to, retransmissions, false);
+	BINLOG(LOG_RUNICAST_TIMEOUT, BINLOG_ADDR(to), retransmissions);
+	if (liveness_failed(to)){
+		monitor_notify(PRINT_LIVENESS);
+	}
 }
 
 static const struct broadcast_callbacks broadcast_call = {broadcast_recv, broadcast_sent};
@@ -103,7 +450,8 @@ uint8_t send_uc_msg(msg_t* msg, uint32_t size, linkaddr_t dest_addr){
 	if(!runicast_is_transmitting(&runicast)) {
 		linkaddr_t recv = dest_addr;
 		packetbuf_copyfrom(msg, size);
-		runicast_send(&runicast, &recv, MAX_RETRANSMISSIONS );
+		TRACE_TX(RU_CH, &recv);
+		runicast_send(&runicast, &recv, link_prepare(&recv));
 	}
     else {
         return 1;
@@ -115,6 +463,8 @@ uint8_t send_uc_msg(msg_t* msg, uint32_t size, linkaddr_t dest_addr){
 uint8_t send_bc_msg(void* msg, uint32_t size){
 	if(!runicast_is_transmitting(&runicast)) {
 		packetbuf_copyfrom(msg, size);
+        TRACE_TX(BC_CH, &linkaddr_null);
+        link_prepare_broadcast();
         broadcast_send(&broadcast);
 	}
     else {
@@ -123,204 +473,511 @@ uint8_t send_bc_msg(void* msg, uint32_t size){
     return 0;
 }
 
-PROCESS_THREAD(main_process, ev, data){
-    PROCESS_BEGIN();
+// Last digest received from each actuator. The CU view of the nodes is
+// reconciled from them so that it doesn't drift after a lost frame
+static uint16_t door_digest;
+static uint16_t gate_digest;
+static uint8_t digest_seen = 0x0;
+
+// Update the node state with the digest just received, returns true if the
+// CU view of the nodes has changed
+bool reconcile_state (uint16_t digest){
+    enum alarm_state door_alarm;
+    enum alarm_state gate_alarm;
+    enum alarm_state new_alarm;
+    enum lock_state new_lock = gate_lock_state;
+    enum entrance_state new_entrance = CLOSED;
+    enum onoff_state new_hvac = hvac_state;
+    bool changed;
+
+    if (IS_FROM_DOOR()){
+        door_digest = digest;
+        digest_seen |= DOOR_ACK_MASK;
+    }
+    else if (IS_FROM_GATE()){
+        gate_digest = digest;
+        digest_seen |= GATE_ACK_MASK;
+    }
+    else {
+        return false;
+    }
 
-	static enum message out_msg;
-    static enum monitor_message mon_msg;
-    static msg_t msg;
-    static struct etimer monitor_timer;
+    // A node not heard yet is assumed to agree with the other one
+    door_alarm = DIGEST_ALARM((digest_seen & DOOR_ACK_MASK) ? door_digest : gate_digest);
+    gate_alarm = (digest_seen & GATE_ACK_MASK) ? DIGEST_ALARM(gate_digest) : door_alarm;
 
-    // Init state
-    linkaddr_set_node_addr(&cu_addr);
-    update_monitor_ev = process_alloc_event();
-    update_state_ev = process_alloc_event();
-    cmd_issued = NO_CMD;
-    alarm_state = DISABLED;
-    entrance_state = CLOSED;
-    gate_lock_state = UNLOCKED;
-    light = INT_MIN;
-    temperature = INT_MAX;
-    mon_msg = PRINT_MENU;
-
-    process_post(&monitor_process, update_monitor_ev, (void*) mon_msg);
-	while (true){
-		PROCESS_WAIT_EVENT();
-        // A valid command has been issued
-        if (ev == valid_cmd_ev){
-			cmd_issued = (enum message) data;
-            process_post(&monitor_process, update_monitor_ev, (void*) PRINT_ISSUED_COMMAND);
-            if (alarm_state == ENABLED && cmd_issued != ALARM_ON_OFF){
-                cmd_issued = NO_CMD;
-                mon_msg = PRINT_COMMAND_NOT_VALID;
-            }
-            else {
-                switch (cmd_issued) {
-                    case ALARM_ON_OFF:
-                        out_msg = (alarm_state == ENABLED) ? ALARM_DISABLED : ALARM_ENABLED;
-                        break;
+    // If only one node is still armed the alarm is shown as active, so the
+    // user can still issue the (absolute) disable command
+    if (door_alarm == ENABLING || gate_alarm == ENABLING){
+        new_alarm = ENABLING;
+    }
+    else if (door_alarm == ENABLED || gate_alarm == ENABLED){
+        new_alarm = ENABLED;
+    }
+    else {
+        new_alarm = DISABLED;
+    }
+    if (digest_seen & GATE_ACK_MASK){
+        new_lock = DIGEST_LOCK(gate_digest);
+        if (DIGEST_ENTRANCE(gate_digest) == MOVING){
+            new_entrance = MOVING;
+        }
+    }
+    if (digest_seen & DOOR_ACK_MASK){
+        // The HVAC state comes back with the checkpoint of a restarted Door
+        new_hvac = DIGEST_HVAC(door_digest);
+        if (DIGEST_ENTRANCE(door_digest) == MOVING){
+            new_entrance = MOVING;
+        }
+    }
 
-                    case GATE_UN_LOCK:
-                        if (entrance_state == CLOSED){
-                            out_msg = (gate_lock_state == UNLOCKED) ? GATE_LOCK : GATE_UNLOCK;
-                        }
-                        else {
-                            cmd_issued = NO_CMD;
-                            mon_msg = PRINT_WAIT_CLOSE;
-                        }
-                        break;
+    changed = new_alarm != alarm_state || new_lock != gate_lock_state ||
+              new_entrance != entrance_state || new_hvac != hvac_state;
+    alarm_state = new_alarm;
+    gate_lock_state = new_lock;
+    entrance_state = new_entrance;
+    hvac_state = new_hvac;
+    return changed;
+}
 
-                    case ENTRANCE_OPEN_CLOSE:
-                        if (gate_lock_state == LOCKED){
-                            cmd_issued = NO_CMD;
-                            mon_msg = PRINT_UNLOCK_GATE;
-                        }
-                        else if (entrance_state == CLOSED){
-                            out_msg = ENTRANCE_OPEN;
-                            mon_msg = PRINT_ENTRANCE_OPEN;
-                        }
-                        else {
-                            cmd_issued = NO_CMD;
-                            mon_msg = PRINT_WAIT_CLOSE;
-                        }
-                        break;
+// Once the Door digest has been received its sample window fill tells if an
+// average is available, before that the warm up time is assumed
+bool temp_window_ready (struct stimer* warm_up){
+    if (digest_seen & DOOR_ACK_MASK){
+        return DIGEST_FILL(door_digest) >= SMPL_NUM;
+    }
+    return stimer_expired(warm_up) != 0;
+}
 
-                    case TEMP_AVG:
-                        out_msg = GET_TEMP;
-                        break;
+// The command seqs start again from 1 at every boot, the epoch tells the nodes
+// the ones they have seen are from before. It is kept in the checkpoint, the
+// only state of the CU in flash
+struct cu_checkpoint {
+    uint8_t epoch;
+};
 
-                    case EXT_LIGHT:
-                        out_msg = GET_LIGHT;
-                        break;
+uint8_t cu_next_epoch (){
+    struct cu_checkpoint ckpt;
 
-                    case HVAC_ON_OFF:
-                        cmd_issued = NO_CMD;
-                        mon_msg = PRINT_COMMAND_NOT_VALID;
-                        break;
+    if (!persist_load(&ckpt, sizeof(ckpt))){
+        ckpt.epoch = 0;
+    }
+    ++ckpt.epoch;
+    persist_store(&ckpt, sizeof(ckpt));
+    return ckpt.epoch;
+}
 
-                    default:
-                        cmd_issued = NO_CMD;
-                        mon_msg = PRINT_COMMAND_NOT_VALID;
-                        break;
-                }
-            }
-            if (cmd_issued != NO_CMD){
-                process_post(&msg_process, PROCESS_EVENT_MSG, (void*) out_msg);
-            }
-            else {
-                etimer_set(&monitor_timer, MONITOR_PAUSE);
-                process_post(&monitor_process, update_monitor_ev, (void*) mon_msg);
-            }
-		}
+// Send the pending command, linkaddr_null as destination means broadcast.
+// Unicast commands are reliable once runicast has accepted them, broadcast
+// ones are pending until acknowledged by the nodes
+void send_pending_cmd (){
+    if (linkaddr_cmp(&pending_dest, &linkaddr_null)){
+        send_bc_msg(&pending_cmd, sizeof(msg_t));
+    }
+    else if (send_uc_msg(&pending_cmd, sizeof(msg_t), pending_dest) == 0){
+        cmd_pending = false;
+    }
+}
 
-        // A message from message process has been received
-        if (ev == update_state_ev){
-            etimer_set(&monitor_timer, MONITOR_PAUSE);
-            msg = get_message_from(data);
-            if (msg.hdr == CMD_MSG){
-                switch (msg.payload){
-                    case ALARM_ENABLING:
-                        alarm_state = ENABLING;
-                        mon_msg = PRINT_ALARM_ENABLING;
-                        break;
+// Must be called from msg_process only since it owns the retransmission timer
+void send_cmd (msg_t* msg, const linkaddr_t* dest, uint8_t group){
+    if (++cmd_seq == 0){
+        cmd_seq = 1;
+    }
+    msg->seq = cmd_seq;
+    msg->group = group;
+    pending_cmd = *msg;
+    linkaddr_copy(&pending_dest, dest);
+    pending_retx = 0;
+    cmd_pending = true;
+    send_pending_cmd();
+    if (linkaddr_cmp(dest, &linkaddr_null)){
+        etimer_set(&retx_timer, CMD_RETX_PERIOD);
+    }
+    else {
+        etimer_set(&retx_timer, link_backoff(dest, CMD_RETX_PERIOD));
+    }
+}
 
-                    case ALARM_DISABLED:
-                    case ALARM_ENABLED:
-                        alarm_state = (msg.payload == ALARM_ENABLED) ? ENABLED : DISABLED;
-                        mon_msg = (alarm_state == ENABLED) ? PRINT_ALARM_ACTIVE :
-                                                             PRINT_ALARM_DISABLED;
-                        break;
+// The entrances open at the start time of the scene, the Door after the
+// guest wait, and close after the open time
+clock_time_t scene_timeout (){
+    int16_t open;
 
-                    case GATE_LOCK:
-                    case GATE_UNLOCK:
-                        gate_lock_state = (msg.payload == GATE_LOCK) ? LOCKED : UNLOCKED;
-                        mon_msg = PRINT_LOCKED_GATE;
-                        break;
+    open = (open_seconds[0] > open_seconds[1]) ? open_seconds[0] : open_seconds[1];
+    return SYNC_ACTUATION_DELAY + GUEST_WAIT + (clock_time_t) open * CLOCK_SECOND + SCENE_MARGIN;
+}
 
-                    case ENTRANCE_OPEN:
-                    case ENTRANCE_CLOSE:
-                        if (msg.payload == ENTRANCE_OPEN){
-                            entrance_state = MOVING;
-                            mon_msg = PRINT_ENTRANCE_OPEN;
-                        }
-                        else {
-                            entrance_state = CLOSED;
-                            mon_msg = PRINT_ENTRANCE_CLOSED;
-                        }
-                        break;
+// All the reports of the scene are in, or the wait is over. Alarm, lock and
+// entrance come with the digests the nodes send after the scene, the HVAC
+// state only from the report
+void scene_done (){
+    uint8_t action;
+    uint8_t i;
+
+    for (i = 0; i < SCENE_STEPS; ++i){
+        action = SCENE_STEP(scene_steps, i);
+        if ((action == HVAC_ON || action == HVAC_OFF) &&
+            SCENE_RESULT(scene_result, i) == SCENE_DONE){
+            hvac_state = (action == HVAC_ON) ? ON : OFF;
+        }
+    }
+    // Late reports are ignored, a command issued after the scene is still
+    // retransmitted
+    if (cmd_pending && pending_cmd.seq == scene_seq){
+        cmd_pending = false;
+    }
+    scene_seq = 0;
+    monitor_notify(PRINT_SCENE);
+}
 
-                    case GET_LIGHT:
-                        mon_msg = PRINT_LIGHT_REQUESTED;
-                        break;
+// "param cu|door|gate [name [value [save]]]", the CU parameters are read and
+// set here, the others with a request to the node. Must be called from
+// msg_process only since it uses send_cmd()
+void param_command (char* args){
+    char* node = strtok(args, " ");
+    char* name = strtok(NULL, " ");
+    char* value = strtok(NULL, " ");
+    char* save = strtok(NULL, " ");
+    linkaddr_t dest;
+    uint8_t group;
+    enum param_op op;
+    int8_t id;
+    msg_t msg;
+
+    if (node != NULL && strcmp(node, "cu") == 0 && name == NULL){
+        param_print();
+        return;
+    }
+    id = (name != NULL) ? param_find(name) : -1;
+    if (node == NULL || id < 0 || (save != NULL && strcmp(save, "save") != 0)){
+        printf("usage: param cu|door|gate [name [value [save]]]\n");
+        return;
+    }
+    op = (value == NULL) ? PARAM_GET : (save != NULL) ? PARAM_SET_SAVE : PARAM_SET;
 
-                    default:
-                        printf("\nMessage not recognized\n");
-                        break;
-                }
-            }
-            else if (msg.hdr == LIGHT_MSG){
-                light = msg.payload;
-                mon_msg = PRINT_LIGHT;
-            }
-            else if (msg.hdr == TEMP_MSG){
-                if (msg.payload == (uint16_t) INT_MIN){
-                    mon_msg = PRINT_WAIT_TEMP;
+    if (strcmp(node, "cu") == 0){
+        if (op != PARAM_GET && !param_set(id, atoi(value))){
+            printf("Param %s not on the cu or out of range\n", name);
+        }
+        else if (op == PARAM_SET_SAVE){
+            param_save();
+        }
+        printf("Param cu %s = %d\n", name, param_get(id));
+        return;
+    }
+    if (strcmp(node, "door") == 0){
+        linkaddr_copy(&dest, &door_addr);
+        group = GROUP_DOOR;
+        param_node = PARAM_DOOR;
+    }
+    else if (strcmp(node, "gate") == 0){
+        dest.u8[0] = GATE_ADDR_0;
+        dest.u8[1] = GATE_ADDR_1;
+        group = GROUP_GATE;
+        param_node = PARAM_GATE;
+    }
+    else {
+        printf("usage: param cu|door|gate [name [value [save]]]\n");
+        return;
+    }
+    msg = set_message(PARAM_MSG, (value != NULL) ? (uint16_t) atoi(value) : 0);
+    msg.time = PARAM_REQUEST(op, id);
+    send_cmd(&msg, &dest, group);
+    param_seq = msg.seq;
+    param_id = id;
+}
+
+// The node answers with the value in use, unchanged if the new one has been
+// refused
+void param_reply (uint16_t value){
+    const char* node = (param_node == PARAM_DOOR) ? "door" : "gate";
+
+    param_seq = 0;
+    if ((int16_t) value == INT16_MIN){
+        printf("Param %s not on the %s\n", param_name(param_id), node);
+        return;
+    }
+    printf("Param %s %s = %d\n", node, param_name(param_id), (int16_t) value);
+
+    // Temperature requests are answered by the CU for a Door sample period
+    if (param_node == PARAM_DOOR && param_id == PARAM_SMPL_SECONDS){
+        param_set(param_id, (int16_t) value);
+    }
+    // and scenes are waited for with the open time of the nodes
+    if (param_id == PARAM_OPEN_SECONDS){
+        open_seconds[param_node == PARAM_GATE] = (int16_t) value;
+    }
+}
+
+#if CU_STRESS
+// Requests in flight indexed by seq, a request still in flight when its slot
+// is reused is counted as lost
+static clock_time_t stress_sent_at[STRESS_WINDOW];
+static bool stress_inflight[STRESS_WINDOW];
+static uint16_t stress_sent;
+static uint16_t stress_ok;
+static uint16_t stress_lost;
+static uint16_t stress_busy;
+static uint32_t stress_latency_sum;
+static clock_time_t stress_latency_max;
+static struct ctimer stress_cmd_timer;
+static struct ctimer stress_report_timer;
+
+static void stress_send (uint8_t node){
+    linkaddr_t dest;
+    msg_t msg;
+    uint8_t slot;
+
+    // Addresses of the actuators skip the CU one
+    dest.u8[0] = (node < CU_ADDR_0) ? node : node + 1;
+    dest.u8[1] = 0;
+    if (++cmd_seq == 0){
+        cmd_seq = 1;
+    }
+    msg = set_message(CMD_MSG, (dest.u8[0] & 0x01) ? GET_TEMP : GET_LIGHT);
+    msg.seq = cmd_seq;
+    if (send_uc_msg(&msg, sizeof(msg), dest) != 0){
+        ++stress_busy;
+        return;
+    }
+    slot = cmd_seq % STRESS_WINDOW;
+    if (stress_inflight[slot]){
+        ++stress_lost;
+    }
+    stress_inflight[slot] = true;
+    stress_sent_at[slot] = clock_time();
+    ++stress_sent;
+}
+
+// Returns true if msg is the reply to a stress request
+static bool stress_reply (msg_t* msg){
+    uint8_t slot = msg->seq % STRESS_WINDOW;
+    clock_time_t latency;
+
+    if ((msg->hdr != TEMP_MSG && msg->hdr != LIGHT_MSG) || msg->seq == 0 ||
+        !stress_inflight[slot]){
+        return false;
+    }
+    stress_inflight[slot] = false;
+    latency = clock_time() - stress_sent_at[slot];
+    stress_latency_sum += latency;
+    if (latency > stress_latency_max){
+        stress_latency_max = latency;
+    }
+    ++stress_ok;
+    return true;
+}
+
+static void stress_report (){
+    unsigned long avg_ms = 0;
+#if LINK_IMPAIR
+    // Frames sent and received by the CU in the period, their ratio to the
+    // replies is the overhead of the retransmissions on the impaired link
+    static uint16_t frames_last;
+    const struct impair_stats* impair = impair_mac_stats();
+    uint16_t frames = impair->sent + impair->frames - frames_last;
+
+    frames_last = impair->sent + impair->frames;
+#else
+    uint16_t frames = 0;
+#endif
+
+    if (stress_ok > 0){
+        avg_ms = (stress_latency_sum * 1000UL / CLOCK_SECOND) / stress_ok;
+    }
+    printf("STRESS nodes %u rate %u sent %u ok %u lost %u busy %u ok/s %u latency avg %lu max %lu ms frames %u\n",
+           CU_STRESS_NODES, CU_STRESS_RATE, stress_sent, stress_ok, stress_lost,
+           stress_busy, stress_ok / (STRESS_REPORT_PERIOD / CLOCK_SECOND),
+           avg_ms, (unsigned long) stress_latency_max * 1000UL / CLOCK_SECOND, frames);
+    stress_sent = 0;
+    stress_ok = 0;
+    stress_lost = 0;
+    stress_busy = 0;
+    stress_latency_sum = 0;
+    stress_latency_max = 0;
+}
+
+static void stress_tick (void* ptr){
+    static uint8_t node = 1;
+
+    WAKE_CALLBACK();
+    stress_send(node);
+    node = (node % CU_STRESS_NODES) + 1;
+    ctimer_reset(&stress_cmd_timer);
+}
+
+static void stress_period (void* ptr){
+    WAKE_CALLBACK();
+    stress_report();
+    ctimer_reset(&stress_report_timer);
+}
+
+// The requests go out from the callbacks, in the context of msg_process
+static void stress_open (){
+    ctimer_set(&stress_cmd_timer, CLOCK_SECOND / CU_STRESS_RATE, stress_tick, NULL);
+    ctimer_set(&stress_report_timer, STRESS_REPORT_PERIOD, stress_period, NULL);
+}
+#endif
+
+// Shown by the UI until the menu is drawn again, PARAM_MONITOR_MS after the
+// last update
+static enum monitor_message ui_mon_msg;
+static struct ctimer menu_timer;
+
+// Presses of the button counted so far
+static uint8_t button_count = 0;
+static struct ctimer button_timer;
+
+static void ui_menu (void* ptr){
+    WAKE_CALLBACK();
+    ui_mon_msg = PRINT_MENU;
+    monitor_notify(ui_mon_msg);
+}
+
+// A command issued by the user, checked against the state of the nodes and
+// passed to msg_process to be sent. False if the event queue is full, a
+// refused command has been handled
+static bool ui_command (enum user_command cmd){
+    enum message out_msg;
+    struct cu_view view;
+
+    cmd_issued = cmd;
+    monitor_notify(PRINT_ISSUED_COMMAND);
+    // The steps of a scene are checked by the nodes as they run them
+    if (cmd_issued == SCENE_1 || cmd_issued == SCENE_2){
+        return post_event(&msg_process, scene_ev, (void*) (int) (cmd_issued - SCENE_1));
+    }
+    view.alarm = alarm_state;
+    view.entrance = entrance_state;
+    view.lock = gate_lock_state;
+    view.hvac = hvac_state;
+    switch (command_check(cmd_issued, &view, &out_msg)){
+        case CMD_ACCEPTED:
+            break;
+
+        case CMD_WAIT_CLOSE:
+            cmd_issued = NO_CMD;
+            ui_mon_msg = PRINT_WAIT_CLOSE;
+            break;
+
+        case CMD_UNLOCK_GATE:
+            cmd_issued = NO_CMD;
+            ui_mon_msg = PRINT_UNLOCK_GATE;
+            break;
+
+        default:
+            cmd_issued = NO_CMD;
+            ui_mon_msg = PRINT_COMMAND_NOT_VALID;
+            break;
+    }
+    if (cmd_issued != NO_CMD){
+        return post_event(&msg_process, PROCESS_EVENT_MSG, (void*) out_msg);
+    }
+    ctimer_set(&menu_timer, param_ticks(PARAM_MONITOR_MS), ui_menu, NULL);
+    monitor_notify(ui_mon_msg);
+    return true;
+}
+
+// State of the nodes changed by a message from them, or by a command whose
+// ack is implicit
+static void ui_update (const msg_t* msg){
+    ctimer_set(&menu_timer, param_ticks(PARAM_MONITOR_MS), ui_menu, NULL);
+    if (msg->hdr == CMD_MSG){
+        switch (msg->payload){
+            case ALARM_ENABLING:
+                alarm_state = ENABLING;
+                ui_mon_msg = PRINT_ALARM_ENABLING;
+                break;
+
+            case GATE_LOCK:
+            case GATE_UNLOCK:
+                gate_lock_state = (msg->payload == GATE_LOCK) ? LOCKED : UNLOCKED;
+                ui_mon_msg = PRINT_LOCKED_GATE;
+                break;
+
+            case ENTRANCE_OPEN:
+            case ENTRANCE_CLOSE:
+                if (msg->payload == ENTRANCE_OPEN){
+                    entrance_state = MOVING;
+                    ui_mon_msg = PRINT_ENTRANCE_OPEN;
                 }
                 else {
-                    temperature = msg.payload;
-                    mon_msg = PRINT_TEMP;
+                    entrance_state = CLOSED;
+                    ui_mon_msg = PRINT_ENTRANCE_CLOSED;
                 }
-            }
-            process_post(&monitor_process, update_monitor_ev, (void*) mon_msg);
+                break;
+
+            case GET_LIGHT:
+                ui_mon_msg = PRINT_LIGHT_REQUESTED;
+                break;
+
+            case HVAC_ON:
+            case HVAC_OFF:
+                hvac_state = (msg->payload == HVAC_ON) ? ON : OFF;
+                ui_mon_msg = PRINT_HVAC;
+                break;
+
+            default:
+                BINLOG(LOG_UNKNOWN_MESSAGE, msg->hdr, msg->payload);
+                break;
         }
-        if (ev == PROCESS_EVENT_TIMER && etimer_expired(&monitor_timer)){
-            mon_msg = PRINT_MENU;
-            process_post(&monitor_process, update_monitor_ev, (void*) mon_msg);
+    }
+    else if (msg->hdr == LIGHT_MSG){
+        light = msg->payload;
+        light_time = msg->time;
+        ui_mon_msg = PRINT_LIGHT;
+    }
+    else if (msg->hdr == TEMP_MSG){
+        if (msg->payload == (uint16_t) INT_MIN){
+            ui_mon_msg = PRINT_WAIT_TEMP;
         }
-	}
-	PROCESS_END();
+        else {
+            temperature = msg->payload;
+            temperature_time = msg->time;
+            ui_mon_msg = PRINT_TEMP;
+        }
+    }
+    else if (msg->hdr == HVAC_MSG){
+        hvac_setpoint = (int16_t) msg->payload;
+        hvac_time = msg->time;
+        ui_mon_msg = PRINT_HVAC_SETPOINT;
+    }
+    monitor_notify(ui_mon_msg);
+}
 
-	return 0;
+// The command is the number of presses, issued once the button has been left
+// alone for PARAM_CMD_MS
+static void button_done (void* ptr){
+    WAKE_CALLBACK();
+    ui_command((enum user_command) button_count);
+    button_count = 0;
 }
 
-PROCESS_THREAD(button_process, ev, data){
-	static uint8_t button_count = 0;
-	static struct etimer button_timer;
+static void button_pressed (){
+    ++button_count;
 
-    PROCESS_BEGIN();
+    // Check if user has pressed the button too many times
+    if (button_count > MAX_BUTTON_PRESS){
+        button_count = 0;
+        ctimer_stop(&button_timer);
+    }
+    else {
+        ctimer_set(&button_timer, param_ticks(PARAM_CMD_MS), button_done, NULL);
+    }
+}
 
-	// Event fired when the user has issued a valid command
-    valid_cmd_ev = process_alloc_event();
+#if CU_COAP
+// Commands coming from CoAP take the same path as the ones from the button
+bool cu_issue_command (enum user_command cmd){
+    return ui_command(cmd);
+}
 
-	SENSORS_ACTIVATE(button_sensor);//Button sensor activation
-	while (true){
-        PROCESS_WAIT_EVENT();
-		if (ev == sensors_event && data == &button_sensor) {
-            if (button_count == 0)
-                etimer_set(&button_timer, CMD_PERIOD);
-            else
-                etimer_restart(&button_timer);
-            ++button_count;
-
-            // Check if user has pressed the button too many times
-			if(button_count > MAX_BUTTON_PRESS) {
-				button_count = 0;
-				etimer_stop(&button_timer);
-			} else
-				etimer_restart(&button_timer);
-		}
-        // Send the command issued
-        if (ev == PROCESS_EVENT_TIMER && etimer_expired(&button_timer)){
-			if (process_post(&main_process, valid_cmd_ev, (void*) (int) button_count) != PROCESS_ERR_OK) {
-                process_post(&monitor_process, update_monitor_ev, (void*) PRINT_FULL_QUEUE);
-			}
-            button_count = 0;
-		}
-	}
-	SENSORS_DEACTIVATE(button_sensor);
-	PROCESS_END();
-	return 0;
+// Sent by msg_process, which owns the retransmission timer of send_cmd()
+bool cu_issue_setpoint (int setpoint){
+    return process_post(&msg_process, setpoint_ev, (void*) setpoint) == PROCESS_ERR_OK;
 }
+#endif
 
 PROCESS_THREAD(msg_process, ev, data){
     static msg_t msg;
@@ -328,41 +985,117 @@ PROCESS_THREAD(msg_process, ev, data){
     static struct stimer temp_smpl_timer;
     static struct stimer wait_temp_avg;
     static linkaddr_t dest_addr;
-    static bool is_temp_ready = false;
+    static int setpoint;
+    static struct etimer scene_timer;
+    static uint8_t scene_num;
+    static struct etimer liveness_timer;
 
     PROCESS_EXITHANDLER(broadcast_close(&broadcast));
     PROCESS_EXITHANDLER(runicast_close(&runicast));
     PROCESS_BEGIN();
 
-    // Init
+    // Init, the parameters first since the timers use them
     static uint8_t closed_entrance_bit = 0x0;
-    static uint8_t alarm_on_bit = 0x0;
-    update_state_ev = process_alloc_event();
+    linkaddr_set_node_addr(&cu_addr);
+    param_init(PARAM_CU);
+    // Until read from the nodes, they are taken as using the default
+    open_seconds[0] = open_seconds[1] = param_get(PARAM_OPEN_SECONDS);
+    cmd_issued = NO_CMD;
+    alarm_state = DISABLED;
+    entrance_state = CLOSED;
+    gate_lock_state = UNLOCKED;
+    hvac_state = OFF;
+    hvac_setpoint = HVAC_SETPOINT_DEFAULT;
+    light = INT_MIN;
+    temperature = INT_MAX;
+    ui_mon_msg = PRINT_MENU;
+    monitor_notify(ui_mon_msg);
+
     sensor_msg_ev = process_alloc_event();
-    stimer_set(&wait_temp_avg, 5*SMPL_TEMP_PERIOD_SECONDS);
+    setpoint_ev = process_alloc_event();
+    scene_ev = process_alloc_event();
+    stimer_set(&wait_temp_avg, SMPL_NUM * param_get(PARAM_SMPL_SECONDS));
     broadcast_open(&broadcast, BC_CH, &broadcast_call);
     runicast_open(&runicast, RU_CH, &runicast_calls);
+    netsync_open(true);
+    netsync_set_epoch(cu_next_epoch());
+    binlog_open();
+    TRACE_OPEN();
+    inflight_init();
+    ota_sender_open();
+    liveness_watch(&door_addr);
+    dest_addr.u8[0] = GATE_ADDR_0;
+    dest_addr.u8[1] = GATE_ADDR_1;
+    liveness_watch(&dest_addr);
+    etimer_set(&liveness_timer, CLOCK_SECOND);
+    wake_open();
+    SENSORS_ACTIVATE(button_sensor);
+#if CU_STRESS
+    stress_open();
+#endif
+#if CU_COAP
+    cucoap_open();
+#endif
 
     while (true) {
         PROCESS_WAIT_EVENT();
-        if (ev == sensor_msg_ev){
-            msg = get_message_from(data);
-            if (msg.hdr == CMD_MSG){
+        if (ev == sensors_event && data == &button_sensor){
+            button_pressed();
+        }
+        else if (ev == sensor_msg_ev){
+            msg = ((struct lane_entry*) data)->msg;
+            last_sender[0] = ((struct lane_entry*) data)->from.u8[0];
+            last_sender[1] = ((struct lane_entry*) data)->from.u8[1];
+            ++rx_tail;
+            if (msg.hdr == TEMP_MSG || msg.hdr == LIGHT_MSG){
+                dest_addr.u8[0] = last_sender[0];
+                dest_addr.u8[1] = last_sender[1];
+                history_record(&dest_addr, &msg);
+                inflight_complete(&dest_addr, msg.hdr);
+                // The Door average changes once per sample period, until
+                // then the requests are answered with this one
+                if (msg.hdr == TEMP_MSG && msg.payload != (uint16_t) INT_MIN){
+                    stimer_set(&temp_smpl_timer, param_get(PARAM_SMPL_SECONDS));
+                }
+            }
+#if CU_STRESS
+            // Replies to the stress requests don't reach the UI
+            if (stress_reply(&msg)){
+                continue;
+            }
+#endif
+            if (msg.hdr == PARAM_MSG){
+                if (msg.seq == param_seq && param_seq != 0){
+                    param_reply(msg.payload);
+                }
+            }
+            else if (msg.hdr == SCENE_MSG){
+                // One report from every actuator, merged step by step
+                if (msg.seq == scene_seq && scene_seq != 0){
+                    scene_result = scene_merge(scene_result, msg.payload);
+                    if (IS_FROM_DOOR()){
+                        scene_reports |= DOOR_ACK_MASK;
+                    }
+                    if (IS_FROM_GATE()){
+                        scene_reports |= GATE_ACK_MASK;
+                    }
+                    if (scene_reports == ALL_ACK_MASK){
+                        scene_done();
+                        etimer_stop(&scene_timer);
+                    }
+                }
+            }
+            else if (msg.hdr == STATE_MSG){
+                // Redraw the menu only if nothing else is being shown
+                if (reconcile_state(msg.payload) && !cmd_pending){
+                    monitor_notify(PRINT_MENU);
+                }
+#if CU_COAP
+                cucoap_changed(CUCOAP_STATE);
+#endif
+            }
+            else if (msg.hdr == CMD_MSG){
                 switch (msg.payload){
-                    case ALARM_ENABLED:
-                    case ALARM_DISABLED:
-                        if (IS_FROM_DOOR()){
-                            alarm_on_bit |= DOOR_ACK_MASK;
-                        }
-                        if (IS_FROM_GATE()){
-                            alarm_on_bit |= GATE_ACK_MASK;
-                        }
-                        if (alarm_on_bit == ALL_ACK_MASK){
-                            process_post(&main_process, update_state_ev, (void*) &msg);
-                            alarm_on_bit = 0x0;
-                        }
-                        break;
-
                     case ENTRANCE_CLOSE:
                         if (IS_FROM_DOOR()){
                             closed_entrance_bit |= DOOR_ACK_MASK;
@@ -371,18 +1104,96 @@ PROCESS_THREAD(msg_process, ev, data){
                             closed_entrance_bit |= GATE_ACK_MASK;
                         }
                         if (closed_entrance_bit == ALL_ACK_MASK){
-                            process_post(&main_process, update_state_ev, (void*) &msg);
+                            ui_update(&msg);
                             closed_entrance_bit = 0x0;
                         }
                         break;
 
                     default:
-                        process_post(&main_process, update_state_ev, (void*) &msg);
+                        ui_update(&msg);
                         break;
                 }
             }
             else {
-                process_post(&main_process, update_state_ev, (void*) &msg);
+                ui_update(&msg);
+            }
+        }
+        else if (ev == serial_line_event_message && strcmp((char*) data, "links") == 0){
+            link_stats_print();
+            inflight_print();
+#if LINK_IMPAIR
+            impair_mac_print();
+#endif
+        }
+        else if (ev == serial_line_event_message && strcmp((char*) data, "live") == 0){
+            liveness_print(true);
+        }
+        else if (ev == PROCESS_EVENT_TIMER && data == &liveness_timer){
+            if (liveness_check()){
+                monitor_notify(PRINT_LIVENESS);
+            }
+            etimer_reset(&liveness_timer);
+        }
+        else if (ev == serial_line_event_message && strcmp((char*) data, "latency") == 0){
+            alarm_lane_print();
+        }
+        else if (ev == serial_line_event_message && strncmp((char*) data, "history ", 8) == 0){
+            history_print((char*) data + 8);
+        }
+        else if (ev == serial_line_event_message && strncmp((char*) data, "setpoint ", 9) == 0){
+            // Setpoint in hundredths of degree, "setpoint 2150"
+            setpoint = atoi((char*) data + 9);
+            if (setpoint < HVAC_SETPOINT_MIN || setpoint > HVAC_SETPOINT_MAX){
+                printf("Setpoint out of range %d..%d\n", HVAC_SETPOINT_MIN, HVAC_SETPOINT_MAX);
+            }
+            else {
+                msg = set_message(HVAC_MSG, (uint16_t) setpoint);
+                send_cmd(&msg, &door_addr, GROUP_DOOR);
+            }
+        }
+        else if (ev == scene_ev){
+            scene_sent = (uint8_t) (int) data;
+            scene_steps = scenes[scene_sent];
+            msg = set_message(SCENE_MSG, scene_steps);
+            // As ENTRANCE_OPEN, in case the scene opens the entrance at once
+            msg.time = netsync_time() + SYNC_ACTUATION_DELAY;
+            send_cmd(&msg, &linkaddr_null, GROUP_DOOR | GROUP_GATE);
+            scene_seq = msg.seq;
+            scene_result = 0;
+            scene_reports = 0x0;
+            etimer_set(&scene_timer, scene_timeout());
+        }
+        else if (ev == PROCESS_EVENT_TIMER && data == &scene_timer){
+            scene_done();
+        }
+        else if (ev == serial_line_event_message && strncmp((char*) data, "param ", 6) == 0){
+            param_command((char*) data + 6);
+        }
+        else if (ev == serial_line_event_message && strncmp((char*) data, "scene ", 6) == 0){
+            // "scene 1 close lock arm hvac-off"
+            scene_num = atoi((char*) data + 6);
+            if (scene_num < 1 || scene_num > SCENE_NUM || ((char*) data)[7] != ' ' ||
+                !scene_parse((char*) data + 8, &scenes[scene_num - 1])){
+                printf("usage: scene 1|2 action... (arm disarm lock unlock open close "
+                       "hvac-on hvac-off, up to %u)\n", SCENE_STEPS);
+            }
+            else {
+                monitor_notify(PRINT_MENU);
+            }
+        }
+        else if (ev == setpoint_ev){
+            // Already checked by whoever posted it
+            msg = set_message(HVAC_MSG, (uint16_t) (int) data);
+            send_cmd(&msg, &door_addr, GROUP_DOOR);
+        }
+        else if (ev == PROCESS_EVENT_TIMER && data == &retx_timer){
+            if (cmd_pending && pending_retx < param_get(PARAM_CMD_RETX)){
+                ++pending_retx;
+                send_pending_cmd();
+                etimer_restart(&retx_timer);
+            }
+            else {
+                cmd_pending = false;
             }
         }
         else if (ev == PROCESS_EVENT_MSG){
@@ -393,42 +1204,30 @@ PROCESS_THREAD(msg_process, ev, data){
             if (main_msg == GET_TEMP){
                 // INT_MIN means temperature has been requested before 50s have
                 // passed since the start of the network
-                if (stimer_expired(&wait_temp_avg) == 0){
+                if (!temp_window_ready(&wait_temp_avg)){
                     msg.hdr = TEMP_MSG;
                     msg.payload = (uint16_t) INT_MIN;
-                    process_post(&main_process, update_state_ev, (void*) &msg);
+                    ui_update(&msg);
                 }
-                else {
-                    // Set the second timer which expires in 10s, that is the
-                    // temperature sampling time
-                    stimer_set(&temp_smpl_timer, SMPL_TEMP_PERIOD_SECONDS);
+                else if (temperature != INT_MAX && !stimer_expired(&temp_smpl_timer)){
+                    // It isn't needed a new request to the node since it will
+                    // respond the same thing as before
+                    msg.hdr = TEMP_MSG;
+                    msg.payload = temperature;
+                    msg.time = temperature_time;
+                    ui_update(&msg);
+                }
+                // A request already on the air is answered by the same reply
+                else if (inflight_request(&door_addr, TEMP_MSG, clock_seconds())){
                     msg.hdr = CMD_MSG;
                     msg.payload = main_msg;
-                    dest_addr.u8[0] = DOOR_ADDR_0;
-                    dest_addr.u8[1] = DOOR_ADDR_1;
-                    send_uc_msg(&msg, sizeof(msg), dest_addr);
-                }
-                if (is_temp_ready == true){
-                    if (stimer_expired(&temp_smpl_timer) != 0){
-                        stimer_restart(&temp_smpl_timer);
-                        msg.hdr = CMD_MSG;
-                        msg.payload = main_msg;
-                        dest_addr.u8[0] = DOOR_ADDR_0;
-                        dest_addr.u8[1] = DOOR_ADDR_1;
-                        send_uc_msg(&msg, sizeof(msg), dest_addr);
-                    }
-                    else {
-                        // It isn't needed a new request to the node since it will
-                        // respond the same thing as before
-                        msg.hdr = TEMP_MSG;
-                        msg.payload = temperature;
-                        process_post(&main_process, update_state_ev, (void*) &msg);
-                    }
+                    send_cmd(&msg, &door_addr, GROUP_DOOR);
                 }
             }
             else {
                 msg.hdr = CMD_MSG;
                 msg.payload = main_msg;
+                msg.time = 0;
                 // See if it is a broadcast or runicast message to be sent
                 switch (main_msg){
                     case ALARM_ENABLED:
@@ -439,14 +1238,30 @@ PROCESS_THREAD(msg_process, ev, data){
                         // again
                         if (alarm_state == ENABLING){
                             msg.payload = ALARM_ENABLING;
-                            process_post(&main_process, update_state_ev, (void*) &msg);
+                            ui_update(&msg);
+                        }
+                        else {
+                            alarm_acks = 0x0;
+                            send_cmd(&msg, &linkaddr_null, GROUP_DOOR | GROUP_GATE);
                         }
-                        else send_bc_msg(&msg, sizeof(msg));
                         break;
 
                     case ENTRANCE_OPEN:
+                        // Door and gate start moving at the same network
+                        // time. ENTRANCE_OPEN has no ack, it is simply
+                        // repeated for the whole retransmission budget
+                        msg.time = netsync_time() + SYNC_ACTUATION_DELAY;
+                        send_cmd(&msg, &linkaddr_null, GROUP_DOOR | GROUP_GATE);
+                        break;
+
                     case ALARM_DISABLED:
-                        send_bc_msg(&msg, sizeof(msg));
+                        alarm_acks = 0x0;
+                        send_cmd(&msg, &linkaddr_null, GROUP_DOOR | GROUP_GATE);
+                        break;
+
+                    case HVAC_ON:
+                    case HVAC_OFF:
+                        send_cmd(&msg, &door_addr, GROUP_DOOR);
                         break;
 
                     case GET_LIGHT:
@@ -454,12 +1269,17 @@ PROCESS_THREAD(msg_process, ev, data){
                     case GATE_UNLOCK:
                         dest_addr.u8[0] = GATE_ADDR_0;
                         dest_addr.u8[1] = GATE_ADDR_1;
-                        send_uc_msg(&msg, sizeof(msg), dest_addr);
+                        // A light request already on the air is answered by
+                        // the same reply
+                        if (main_msg != GET_LIGHT ||
+                            inflight_request(&dest_addr, LIGHT_MSG, clock_seconds())){
+                            send_cmd(&msg, &dest_addr, GROUP_GATE);
+                        }
 
                         // Since the ack is implicit in the runicast call, there
                         // is the need to update the state of the node with this
                         // call
-                        process_post(&main_process, update_state_ev, (void*) &msg);
+                        ui_update(&msg);
                         break;
 
                     default:
@@ -493,101 +1313,225 @@ void print_framed_int_value(int value, const char* str){
     printf("%s\n", frame);
 }
 
+void print_framed_timed_value(int value, clock_time_t time, const char* str){
+    const char* frame = "#############################################";
+    printf("%s\n", frame);
+    printf("%s: %d\n", str, value);
+    printf("Network time: %u\n", (unsigned int) time);
+    printf("%s\n", frame);
+}
+
+void print_framed_centi_value(int centi, clock_time_t time, const char* str){
+    const char* frame = "#############################################";
+    unsigned int abs_centi = (centi < 0) ? -centi : centi;
+
+    printf("%s\n", frame);
+    printf("%s: %s%u.%02u\n", str, (centi < 0) ? "-" : "", abs_centi / 100,
+                                  abs_centi % 100);
+    printf("Network time: %u\n", (unsigned int) time);
+    printf("%s\n", frame);
+}
+
+// Steps of a scene, with their results if the reports are given
+void print_scene_steps (uint16_t steps, const uint16_t* report){
+    static const char* results[] = {"skipped", "done", "failed", "waiting"};
+    uint8_t i;
+
+    for (i = 0; i < SCENE_STEPS && SCENE_STEP(steps, i) != SCENE_END; ++i){
+        if (report != NULL){
+            printf(" %s: %s", scene_action_name(SCENE_STEP(steps, i)),
+                   results[SCENE_RESULT(*report, i)]);
+        }
+        else {
+            printf(" %s", scene_action_name(SCENE_STEP(steps, i)));
+        }
+    }
+    printf("\n");
+}
+
+void print_framed_scene (){
+    const char* frame = "#############################################";
+
+    printf("%s\n", frame);
+    printf("Scene %u:", scene_sent + 1);
+    print_scene_steps(scene_steps, &scene_result);
+    if (!(scene_reports & DOOR_ACK_MASK)){
+        printf("No report from the door\n");
+    }
+    if (!(scene_reports & GATE_ACK_MASK)){
+        printf("No report from the gate\n");
+    }
+    printf("%s\n", frame);
+}
+
+void print_monitor (enum monitor_message mon_msg){
+    switch (mon_msg){
+        case PRINT_ENTRANCE_CLOSED:
+            print_framed(1, "Entrance has been CLOSED");
+            break;
+
+        case PRINT_ISSUED_COMMAND:
+            print_framed_int_value((int) cmd_issued,
+                                        "Command issued");
+            break;
+
+        case PRINT_MENU:
+            printf("\nAvailable commands are:\n");
+            printf("1. %s alarm signal\n", alarm_state == DISABLED ? "Turn ON" : "Turn OFF");
+            if (alarm_state == DISABLED){
+                if (entrance_state == CLOSED){
+                    printf("2. %s the gate\n", (gate_lock_state == UNLOCKED) ? "LOCK" : "UNLOCK");
+                    printf("%s\n", "3. OPEN and CLOSE door and gate");
+                }
+                printf("4. Average internal temperature of the last 50 seconds\n");
+                printf("5. External light value\n");
+                printf("6. %s HVAC\n", (hvac_state == OFF) ? "Turn ON" : "Turn OFF");
+            }
+            printf("7. Scene:");
+            print_scene_steps(scenes[0], NULL);
+            printf("8. Scene:");
+            print_scene_steps(scenes[1], NULL);
+            break;
+
+        case PRINT_TEMP:
+            print_framed_centi_value(temperature, temperature_time,
+                                     "Average temperature of last 50 seconds:");
+            break;
+
+        case PRINT_ALARM_ENABLING:
+            print_framed(2, "Alarm is enabling on nodes.",
+                            "Wait the entrance to close");
+            break;
+
+        case PRINT_LOCKING_GATE:
+            print_framed(1, "Gate is locking. Wait for it to close.");
+            break;
+
+        case PRINT_LIVENESS:
+            liveness_print(false);
+            break;
+
+        case PRINT_SCENE:
+            print_framed_scene();
+            break;
+
+        case PRINT_TEMP_ALERT:
+            print_framed_centi_value(alert_temperature, alert_time,
+                                     "ALERT! Temperature rising fast at the door");
+            break;
+
+        case PRINT_LIGHT:
+            print_framed_timed_value(light, light_time, "Light measure:");
+            break;
+
+        case PRINT_WAIT_CLOSE:
+            print_framed(2, "Wait door and/or gate to close",
+                            "Then issue this command again");
+            break;
+
+        case PRINT_WAIT_TEMP:
+            print_framed(2, "Please wait a minute for the node",
+                        "to collect enough samples");
+            break;
+
+        case PRINT_FULL_QUEUE:
+            print_framed_int_value(queue_full_count, "Too many events, lost so far");
+            break;
+
+        case PRINT_ALARM_ACTIVE:
+            print_framed(1, "ALARM IS ACTIVE");
+            break;
+
+        case PRINT_UNLOCK_GATE:
+            print_framed(1, "Unlock the gate first");
+            break;
+
+        case PRINT_ALARM_DISABLED:
+            print_framed(1, "ALARM HAS BEEN DISABLED");
+            break;
+
+        case PRINT_COMMAND_NOT_VALID:
+            print_framed(1, "UNKNOWN OR INVALID COMMAND");
+            break;
+
+        case PRINT_LOCKED_GATE:
+            print_framed(1, "Gate is LOCKED");
+            break;
+
+        case PRINT_ENTRANCE_OPEN:
+            print_framed(1, "Entrance is OPENING");
+            break;
+
+        case PRINT_LIGHT_REQUESTED:
+            print_framed(1, "Light requested");
+            break;
+
+        case PRINT_HVAC:
+            print_framed(1, (hvac_state == ON) ? "HVAC is ON" : "HVAC is OFF");
+            break;
+
+        case PRINT_HVAC_SETPOINT:
+            print_framed_centi_value(hvac_setpoint, hvac_time, "HVAC setpoint:");
+            break;
+
+        default:
+            BINLOG(LOG_UNKNOWN_MONITOR, mon_msg, 0);
+            break;
+    }
+}
+
+// Next update to print: the issued command first and the menu last, whatever
+// the order the updates have been notified in
+enum monitor_message monitor_next (){
+    uint8_t mon_msg = PRINT_ISSUED_COMMAND;
+
+    if (!(monitor_dirty & MONITOR_BIT(PRINT_ISSUED_COMMAND))){
+        for (mon_msg = 0; mon_msg < PRINT_MSG_NUM; ++mon_msg){
+            if (mon_msg != PRINT_ISSUED_COMMAND && mon_msg != PRINT_MENU &&
+                (monitor_dirty & MONITOR_BIT(mon_msg))){
+                break;
+            }
+        }
+        if (mon_msg == PRINT_MSG_NUM){
+            mon_msg = PRINT_MENU;
+        }
+    }
+    monitor_dirty &= ~MONITOR_BIT(mon_msg);
+    return (enum monitor_message) mon_msg;
+}
+
 PROCESS_THREAD(monitor_process, ev, data){
-    static enum monitor_message mon_msg;
+    static rtimer_clock_t start;
+    static rtimer_clock_t step;
     PROCESS_BEGIN();
 
     while(true){
-        PROCESS_WAIT_EVENT();
-        if (ev == update_monitor_ev) {
-            mon_msg = (enum monitor_message) data;
-            switch (mon_msg){
-                case PRINT_ENTRANCE_CLOSED:
-                    print_framed(1, "Entrance has been CLOSED");
-                    break;
-
-                case PRINT_ISSUED_COMMAND:
-                    print_framed_int_value((int) cmd_issued,
-                                                "Command issued");
-                    break;
-
-                case PRINT_MENU:
-                    printf("\nAvailable commands are:\n");
-                    printf("1. %s alarm signal\n", alarm_state == DISABLED ? "Turn ON" : "Turn OFF");
-                    if (alarm_state == DISABLED){
-                        if (entrance_state == CLOSED){
-                            printf("2. %s the gate\n", (gate_lock_state == UNLOCKED) ? "LOCK" : "UNLOCK");
-                            printf("%s\n", "3. OPEN and CLOSE door and gate");
-                        }
-                        printf("4. Average internal temperature of the last 50 seconds\n");
-                        printf("5. External light value\n");
-                    }
-                    break;
-
-                case PRINT_TEMP:
-                    print_framed_int_value(temperature,
-                                           "Average temperature of last 50 seconds:");
-                    break;
-
-                case PRINT_ALARM_ENABLING:
-                    print_framed(2, "Alarm is enabling on nodes.",
-                                    "Wait the entrance to close");
-                    break;
-
-                case PRINT_LOCKING_GATE:
-                    print_framed(1, "Gate is locking. Wait for it to close.");
-                    break;
-
-                case PRINT_LIGHT:
-                    print_framed_int_value(light, "Light measure:");
-                    break;
-
-                case PRINT_WAIT_CLOSE:
-                    print_framed(2, "Wait door and/or gate to close",
-                                    "Then issue this command again");
-                    break;
-
-                case PRINT_WAIT_TEMP:
-                    print_framed(2, "Please wait a minute for the node",
-                                "to collect enough samples");
-                    break;
-
-                case PRINT_FULL_QUEUE:
-                    print_framed(1, "Too many command issued");
-                    break;
-
-                case PRINT_ALARM_ACTIVE:
-                    print_framed(1, "ALARM IS ACTIVE");
-                    break;
-
-                case PRINT_UNLOCK_GATE:
-                    print_framed(1, "Unlock the gate first");
-                    break;
-
-                case PRINT_ALARM_DISABLED:
-                    print_framed(1, "ALARM HAS BEEN DISABLED");
-                    break;
-
-                case PRINT_COMMAND_NOT_VALID:
-                    print_framed(1, "UNKNOWN OR INVALID COMMAND");
-                    break;
-
-                case PRINT_LOCKED_GATE:
-                    print_framed(1, "Gate is LOCKED");
-                    break;
-
-                case PRINT_ENTRANCE_OPEN:
-                    print_framed(1, "Entrance is OPENING");
-                    break;
-
-                case PRINT_LIGHT_REQUESTED:
-                    print_framed(1, "Light requested");
-                    break;
-
-                default:
-                    printf("%s: Error. Monitor command unrecognized", __func__);
-                    break;
-            }
+        PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_POLL);
+
+        // One update for every poll, the process polls itself for the others
+        // so the alarm lane never waits for more than one UART write
+        start = RTIMER_NOW();
+        print_monitor(monitor_next());
+        step = RTIMER_NOW() - start;
+        if (step > monitor_step_max){
+            monitor_step_max = step;
+        }
+        if (monitor_dirty != 0){
+            process_poll(&monitor_process);
+        }
+    }
+    PROCESS_END();
+    return 0;
+}
+
+PROCESS_THREAD(alarm_lane_process, ev, data){
+    PROCESS_BEGIN();
+
+    while(true){
+        PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_POLL);
+        while (lane_tail != lane_head){
+            alarm_lane_apply(&alarm_lane[lane_tail]);
+            lane_tail = (lane_tail + 1) % ALARM_LANE_LEN;
         }
     }
     PROCESS_END();
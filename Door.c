@@ -1,71 +1,136 @@
 #include "nesproj.h"
+#include "persist.h"
+#include "netsync.h"
+#include "fixmath.h"
+#include "otaload.h"
+#include "linkstats.h"
+#include "trace.h"
+#include "outbox.h"
+#include "wakes.h"
+#include "liveness.h"
+#include "binlog.h"
+#include "scene.h"
+#include "param.h"
+#include "cqueue.h"
+#include "anomaly.h"
+#include "hvac.h"
 #include "dev/sht11/sht11-sensor.h"
 #include "stdint.h"
 #include "sys/timer.h"
+#include "sys/ctimer.h"
+#include "dev/serial-line.h"
+
+// Built with HVAC_SIM=1 the temperature comes from a model of the room heated
+// and cooled by the HVAC instead of the SHT11, see hvac.h
+#ifndef HVAC_SIM
+#define HVAC_SIM    0
+#endif
+
+#if HVAC_PERIOD_SECONDS != ANOMALY_PERIOD_SECONDS
+#error "the HVAC controller runs on the samples of the anomaly detector"
+#endif
+
+// Groups this node belongs to, zones can be added at build time, e.g.
+// DEFINES=NODE_GROUPS=0x05 for a door in zone 0
+#ifndef NODE_GROUPS
+#define NODE_GROUPS GROUP_DOOR
+#endif
 
 // Sampling temperature period
 #ifndef SMPL_TEMP_PERIOD
 #define SMPL_TEMP_PERIOD    CLOCK_SECOND*10
 #endif
 
-// How many temperature sample to get from the sensor
-#define SMPL_NUM    5
-
 static process_event_t message_from_cu;
-static process_event_t alarm_event;
-static process_event_t start_opening;
-static process_event_t end_opening;
-static process_event_t send_msg;
-static process_event_t get_temp;
-static process_event_t toggle_light;
+static process_event_t duplicate_from_cu;
 
 enum entrance_state door_state;
 enum alarm_state alarm_state;
 enum onoff_state previous_light_state;
 enum onoff_state light_state;
 
-// Process declarations
-PROCESS(msg_process, "Door Node Message Manager Process");
-PROCESS(alarm_process, "Door Node Alarm Process");
-PROCESS(openclose_process, "Door Node Opening Process");
-PROCESS(temp_process, "Door Temperature Sampling Process");
-PROCESS(button_process, "Door Node Button Process");
-PROCESS(main_process, "Door Main Process");
+// A single process dispatches the messages of the CU and the button, the
+// blinking, the opening, the sampling and the digests are ctimer callbacks
+// run in its context
+PROCESS(msg_process, "Door Node Dispatcher");
+AUTOSTART_PROCESSES(&msg_process);
+
+// Last temperature samples, in hundredths of degree
+struct cqueue temp_window;
+// Samples taken since the last checkpoint
+uint8_t unsaved_samples = 0;
+
+struct hvac hvac;
+#if HVAC_SIM
+struct hvac_model room;
+#endif
+
+// Scene being run
+static struct scene scene;
+
+// The opening goes through the synchronized start, the guest wait and the
+// blinking on open_timer
+static struct ctimer open_timer;
+static struct timer open_period;
+static struct ctimer alarm_timer;
+static struct ctimer sample_timer;
+static struct ctimer digest_timer;
+static struct ctimer keepalive_timer;
 
-// Missing processes have to be spawned by other ones
-AUTOSTART_PROCESSES(&msg_process, &temp_process, &button_process, &main_process);
+static struct anomaly detector;
+// Detector samples since the last one of the window
+static uint8_t sample_ticks = 0;
 
-// Circular array where to store temperature samples
-#define CQUEUE_LEN  SMPL_NUM
-int cqueue[CQUEUE_LEN];
-uint8_t cqueue_idx = 0;
-uint32_t sample_num = 0;
-bool queue_filled = false;
+static void alarm_start (void);
+static void alarm_stop (void);
+static void open_start (void* ptr);
+static void open_guest (void* ptr);
 
 // Address of this node
 linkaddr_t door_addr = {{DOOR_ADDR_0, DOOR_ADDR_1}};
+linkaddr_t cu_addr = {{CU_ADDR_0, CU_ADDR_1}};
+
+// Ignores messages from any node except for CU and commands for other
+// groups. A retransmitted command isn't run again, its reply is sent again
+// in case the first one has been lost
+static void from_cu (const linkaddr_t* from){
+    msg_t* msg = (msg_t*) packetbuf_dataptr();
+
+    switch (filter_from_cu(from, msg, NODE_GROUPS)){
+        case RX_ACCEPTED:
+            process_post(&msg_process, message_from_cu, msg);
+            break;
+
+        case RX_DUPLICATE:
+            process_post(&msg_process, duplicate_from_cu, (void*) (int) msg->seq);
+            break;
+
+        default:
+            break;
+    }
+}
 
 // Callbacks for Rime to work
 static void broadcast_recv (struct broadcast_conn *c, const linkaddr_t *from) {
-    // Ignores messages from any node except for CU
-	if (from->u8[0] == CU_ADDR_0 && from->u8[1] == CU_ADDR_1) {
-		process_post(&msg_process, message_from_cu, packetbuf_dataptr());
-	}
+    TRACE_RX(BC_CH, from);
+    link_stats_rx(from);
+    link_stats_beacon(from);
+    from_cu(from);
 }
 
 static void recv_runicast (struct runicast_conn *c, const linkaddr_t *from, uint8_t seqno){
-    // Ignores messages from any node except for CU
-    if(from->u8[0] == CU_ADDR_0 && from->u8[1] == CU_ADDR_1) {
-		process_post(&msg_process, message_from_cu, packetbuf_dataptr());
-	}
+    TRACE_RX(RU_CH, from);
+    link_stats_rx(from);
+    from_cu(from);
 }
 
 static void sent_runicast (struct runicast_conn *c, const linkaddr_t *to, uint8_t retransmissions){
-    // Do nothing
+    link_stats_tx(to, retransmissions, true);
 }
 
 static void timedout_runicast (struct runicast_conn *c, const linkaddr_t *to, uint8_t retransmissions){
-    // Do nothing
+    link_stats_tx(to, retransmissions, false);
+    BINLOG(LOG_RUNICAST_TIMEOUT, BINLOG_ADDR(to), retransmissions);
 }
 
 // Data structure for the rime communication primitives
@@ -77,43 +142,60 @@ static const struct runicast_callbacks runicast_calls = {recv_runicast,
 static struct broadcast_conn broadcast;
 static struct runicast_conn runicast;
 
-// Functions to manage the queue
-void cqueue_init (){
-    uint8_t i;
-    for (i = 0; i < CQUEUE_LEN; ++i){
-        cqueue[i] = INT_MIN;
-    }
+// Node state written to flash and restored at boot, so that a restarted node
+// has its sample window and its alarm state back at once
+struct door_checkpoint {
+    uint8_t alarm;
+    uint8_t light;
+    uint8_t cqueue_idx;
+    uint8_t fill;
+    uint8_t hvac_on;
+    int hvac_setpoint;
+    int cqueue[CQUEUE_LEN];
+};
+
+void door_checkpoint (){
+    struct door_checkpoint ckpt;
+
+    ckpt.alarm = alarm_state;
+    ckpt.light = light_state;
+    ckpt.cqueue_idx = temp_window.idx;
+    ckpt.fill = cqueue_fill(&temp_window);
+    ckpt.hvac_on = hvac.on;
+    ckpt.hvac_setpoint = hvac.setpoint;
+    memcpy(ckpt.cqueue, temp_window.samples, sizeof(ckpt.cqueue));
+    persist_store(&ckpt, sizeof(ckpt));
 }
 
-void cqueue_insert (int v){
-    cqueue[cqueue_idx] = v;
-    cqueue_idx = (cqueue_idx + 1) % SMPL_NUM;
-    if (++sample_num > SMPL_NUM){
-        queue_filled = true;
-    }
-}
+bool door_restore (){
+    struct door_checkpoint ckpt;
 
-int get_avg_temp (){
-    int sum = 0;
-    if (queue_filled == true){
-        uint8_t i;
-        for (i = 0; i < SMPL_NUM; ++i){
-            sum += cqueue[i];
-        }
+    if (!persist_load(&ckpt, sizeof(ckpt))){
+        return false;
     }
-    else {
-        return INT_MIN;
-    }
-    return sum/SMPL_NUM;
+
+    // The door is closed after a reboot, so an alarm which was waiting for it
+    // to close is enabled now
+    alarm_state = (ckpt.alarm == DISABLED) ? DISABLED : ENABLED;
+    light_state = (ckpt.light == ON) ? ON : OFF;
+    memcpy(temp_window.samples, ckpt.cqueue, sizeof(ckpt.cqueue));
+    temp_window.idx = ckpt.cqueue_idx % CQUEUE_LEN;
+    temp_window.fill = (ckpt.fill < CQUEUE_LEN) ? ckpt.fill : CQUEUE_LEN;
+    hvac_set_point(&hvac, ckpt.hvac_setpoint);
+    hvac_set_on(&hvac, ckpt.hvac_on);
+    return true;
 }
 
 uint8_t msg2cu (msg_t *msg){
     if(!runicast_is_transmitting(&runicast)) {
 		linkaddr_t recv;
+		msg->time = netsync_time();
 		packetbuf_copyfrom((void*) msg, sizeof(msg_t));
 		recv.u8[0] = CU_ADDR_0;
 		recv.u8[1] = CU_ADDR_1;
-		runicast_send(&runicast, &recv, MAX_RETRANSMISSIONS);
+		TRACE_TX(RU_CH, &recv);
+		runicast_send(&runicast, &recv, link_prepare(&recv));
+		heartbeat_sent();
 	}
     else {
         return 1;
@@ -133,228 +215,355 @@ void set_leds (){
     }
 }
 
-PROCESS_THREAD(main_process, ev, data){
-    PROCESS_BEGIN();
-    static msg_t msg;
+// Commands carry the target state, so a command sent again with a new seq
+// leaves the node where it is and it is only acknowledged. Returns the state
+// to acknowledge
+enum message door_set_alarm (enum message target){
+    if (target == ALARM_ENABLED){
+        if (door_state == MOVING){
+            // The alarm is enabled once the entrance is closed
+            alarm_state = ENABLING;
+            return ALARM_ENABLING;
+        }
+        if (alarm_state != ENABLED){
+            alarm_start();
+            alarm_state = ENABLED;
+        }
+    }
+    else {
+        if (alarm_state == ENABLED){
+            alarm_stop();
+        }
+        alarm_state = DISABLED;
+    }
+    return target;
+}
 
-    // Init
-    linkaddr_set_node_addr(&door_addr);
-    alarm_state = DISABLED;
-    light_state = OFF;
-    previous_light_state = OFF;
-    door_state = OFF;
-    send_msg = process_alloc_event();
-    set_leds();
+void door_start_opening (clock_time_t at){
+    clock_time_t start_wait;
 
-    while (true){
-        PROCESS_WAIT_EVENT();
-        if (ev == sensors_event && data == &button_sensor){
-            previous_light_state = light_state;
-            light_state = (light_state == OFF) ? ON : OFF;
-            set_leds();
-        }
-        if (ev == alarm_event){
-            msg = get_message_from(data);
+    door_state = MOVING;
+
+    // The entrances start moving together at the time given by the CU
+    start_wait = netsync_wait(at);
+    if (start_wait == 0){
+        ctimer_set(&open_timer, GUEST_WAIT, open_guest, NULL);
+    }
+    else {
+        ctimer_set(&open_timer, start_wait, open_start, NULL);
+    }
+}
+
+enum scene_result door_scene_step (enum message action, uint16_t time){
+    switch (action){
+        case ALARM_ENABLED:
+        case ALARM_DISABLED:
+            door_set_alarm(action);
+            return SCENE_DONE;
+
+        case ENTRANCE_CLOSE:
+            return (door_state == MOVING) ? SCENE_WAIT : SCENE_DONE;
+
+        case ENTRANCE_OPEN:
             if (door_state == MOVING){
-                if (msg.payload == ALARM_DISABLED){
-                    alarm_state = DISABLED;
-                }
-                else {
-                    // it can be only ALARM_ENABLED
-                    alarm_state = ENABLING;
-                    msg.payload = ALARM_ENABLING;
-                }
+                return SCENE_WAIT;
             }
-            switch (alarm_state) {
-                case DISABLED:
-                    process_start(&alarm_process, NULL);
-                    msg.payload = ALARM_ENABLED;
-                    alarm_state = ENABLED;
-                    break;
-
-                case ENABLED:
-                    process_exit(&alarm_process);
-                    msg.payload = ALARM_DISABLED;
-                    alarm_state = DISABLED;
-                    leds_off(LEDS_ALL);
-                    set_leds();
-                    break;
-
-                case ENABLING:
-                    // There is no need to send a confirm to the cu because
-                    // it is sent after the alarm is enabled after the door is
-                    // close
-                    break;
-
-                default:
-                    printf("%s: Error. Unrecognized payload: %d", __func__, msg.payload);
-                    break;
+            if (alarm_state != DISABLED){
+                return SCENE_FAILED;
             }
-            process_post(&msg_process, send_msg, (void*) &msg);
-        }
-        if (ev == start_opening && alarm_state == DISABLED && door_state == CLOSED){
-            door_state = MOVING;
-            process_start(&openclose_process, NULL);
-        }
-        if (ev == end_opening){
-            // Send the message
-            door_state = CLOSED;
-            msg.hdr = CMD_MSG;
-            msg.payload = ENTRANCE_CLOSE;
-            process_post(&msg_process, send_msg, (void*) &msg);
-            if (alarm_state == ENABLING){
-                alarm_state = ENABLED;
-                msg.payload = ALARM_ENABLED;
-                process_start(&alarm_process, NULL);
-                process_post(&msg_process, send_msg, (void*) &msg);
-            }
-        }
-        if (ev == get_temp){
-            msg.hdr = TEMP_MSG;
-            msg.payload = get_avg_temp();
-            process_post(&msg_process, send_msg, (void*) &msg);
-        }
+            door_start_opening((clock_time_t) time);
+            return SCENE_DONE;
+
+        case HVAC_ON:
+        case HVAC_OFF:
+            hvac_set_on(&hvac, action == HVAC_ON);
+            return SCENE_DONE;
+
+        case GATE_LOCK:
+        case GATE_UNLOCK:
+            return SCENE_SKIPPED;
+
+        default:
+            return SCENE_FAILED;
     }
+}
 
-    PROCESS_END();
-    return 0;
+// Blinks all the leds while the alarm is enabled
+static void alarm_blink (void* ptr){
+    WAKE_CALLBACK();
+    leds_toggle(LEDS_ALL);
+    ctimer_reset(&alarm_timer);
 }
 
-PROCESS_THREAD(openclose_process, ev, data){
-    static struct etimer blink_timer;
-    static struct etimer wait_guest;
-    static struct timer blink_period;
+static void alarm_start (){
+    leds_off(LEDS_ALL);
+    leds_toggle(LEDS_ALL);
+    ctimer_set(&alarm_timer, param_ticks(PARAM_BLINK_MS), alarm_blink, NULL);
+}
 
-    PROCESS_BEGIN();
+static void alarm_stop (){
+    ctimer_stop(&alarm_timer);
+    leds_off(LEDS_ALL);
+    set_leds();
+}
 
-    end_opening = process_alloc_event();
-    etimer_set(&wait_guest, CLOCK_SECOND*14);
-    while (true){
-        PROCESS_WAIT_EVENT();
-        if (etimer_expired(&wait_guest)){
-            break;
-        }
+// Digest after a state change, and as keepalive when nothing else has been
+// sent to the CU for DIGEST_PERIOD
+static void digest_put (){
+    msg_t digest = set_message(STATE_MSG, pack_digest(alarm_state, UNLOCKED, door_state,
+                                                      cqueue_fill(&temp_window),
+                                                      hvac.on ? ON : OFF));
+    outbox_put(&digest);
+}
+
+static void keepalive (void* ptr){
+    WAKE_CALLBACK();
+    if (heartbeat_idle() < DIGEST_PERIOD){
+        ctimer_set(&keepalive_timer, DIGEST_PERIOD - heartbeat_idle(), keepalive, NULL);
+        return;
     }
-    timer_set(&blink_period, CLOCK_SECOND*16);
-    leds_on(LEDS_BLUE);
-    etimer_set(&blink_timer, BLINK_PERIOD);
-    do {
-        PROCESS_WAIT_EVENT();
-        if (etimer_expired(&blink_timer)){
-            etimer_restart(&blink_timer);
-            leds_toggle(LEDS_BLUE);
-        }
-    } while (timer_expired(&blink_period) == 0);
-    leds_off(LEDS_BLUE);
-    process_post(&main_process, end_opening, NULL);
-    PROCESS_END();
-    return 0;
+    heartbeat_keepalive();
+    digest_put();
+    ctimer_set(&keepalive_timer, DIGEST_PERIOD, keepalive, NULL);
 }
 
-PROCESS_THREAD(alarm_process, ev, data){
-    static struct etimer blink_period;
+static void digest_send (void* ptr){
+    WAKE_CALLBACK();
+    digest_put();
+    ctimer_set(&keepalive_timer, DIGEST_PERIOD, keepalive, NULL);
+}
 
-    PROCESS_BEGIN();
-    leds_off(LEDS_ALL);
-    etimer_set(&blink_period, BLINK_PERIOD);
-    while (true) {
-        leds_toggle(LEDS_ALL);
-        PROCESS_WAIT_EVENT();
-        if (etimer_expired(&blink_period)){
-            etimer_restart(&blink_period);
-        }
+static void digest_later (){
+    ctimer_set(&digest_timer, DIGEST_DELAY, digest_send, NULL);
+}
+
+static void open_end (){
+    msg_t msg = set_message(CMD_MSG, ENTRANCE_CLOSE);
+    msg_t report;
+
+    door_state = CLOSED;
+    outbox_put(&msg);
+    if (alarm_state == ENABLING){
+        alarm_state = ENABLED;
+        msg.payload = ALARM_ENABLED;
+        alarm_start();
+        outbox_put(&msg);
+        door_checkpoint();
     }
+    digest_later();
 
-    PROCESS_END();
-    return 0;
+    // Steps of a scene waiting for the entrance to close
+    if (scene_advance(&scene, door_scene_step)){
+        report = scene_report(&scene);
+        outbox_put(&report);
+        door_checkpoint();
+    }
 }
 
-PROCESS_THREAD(button_process, ev, data){
-	PROCESS_BEGIN();
+static void open_blink (void* ptr){
+    WAKE_CALLBACK();
+    if (timer_expired(&open_period)){
+        leds_off(LEDS_BLUE);
+        open_end();
+        return;
+    }
+    leds_toggle(LEDS_BLUE);
+    ctimer_reset(&open_timer);
+}
 
-    toggle_light = process_alloc_event();
-	SENSORS_ACTIVATE(button_sensor);
+static void open_guest (void* ptr){
+    WAKE_CALLBACK();
+    timer_set(&open_period, param_ticks(PARAM_OPEN_SECONDS));
+    leds_on(LEDS_BLUE);
+    ctimer_set(&open_timer, param_ticks(PARAM_BLINK_MS), open_blink, NULL);
+}
 
-	while(true) {
-		PROCESS_WAIT_EVENT();
-        if (ev == sensors_event && data == &button_sensor){
-            process_post(&main_process, toggle_light, NULL);
-        }
-	}
+// Synchronized start reached
+static void open_start (void* ptr){
+    WAKE_CALLBACK();
+    ctimer_set(&open_timer, GUEST_WAIT, open_guest, NULL);
+}
+
+// The detector and the HVAC controller run on every sample, the window gets
+// one sample every PARAM_SMPL_SECONDS
+static void temp_sample (void* ptr){
+    msg_t alert;
+    int centi;
+
+    WAKE_CALLBACK();
+    ctimer_reset(&sample_timer);
+#if HVAC_SIM
+    centi = hvac_model_step(&room, hvac.output);
+#else
+    SENSORS_ACTIVATE(sht11_sensor);
+    centi = fix_sht11_centi(sht11_sensor.value(SHT11_SENSOR_TEMP));
+    SENSORS_DEACTIVATE(sht11_sensor);
+#endif
+
+    hvac_step(&hvac, centi);
+#if HVAC_SIM
+    if (hvac.on){
+        printf("HVAC %lu %d %d %d\n", clock_seconds(), centi, hvac.setpoint, hvac.output);
+    }
+#endif
+
+    // Only the rising edge is reported, the CU isn't bothered while the
+    // temperature stays normal
+    if (anomaly_update(&detector, centi) == ANOMALY_RAISED){
+        alert = set_message(ALERT_MSG, (uint16_t) centi);
+        outbox_put(&alert);
+    }
+
+    if (++sample_ticks < param_get(PARAM_SMPL_SECONDS) / ANOMALY_PERIOD_SECONDS){
+        return;
+    }
+    sample_ticks = 0;
+    cqueue_insert(&temp_window, centi);
+    if (++unsaved_samples >= PERSIST_SMPL_BATCH){
+        unsaved_samples = 0;
+        door_checkpoint();
+    }
+}
+
+static void door_hvac (msg_t* msg){
+    if (msg->hdr == HVAC_MSG){
+        // An out of range setpoint is answered with the one in use
+        hvac_set_point(&hvac, (int16_t) msg->payload);
+        msg->payload = hvac.setpoint;
+    }
+    else {
+        hvac_set_on(&hvac, msg->payload == HVAC_ON);
+    }
+    outbox_put(msg);
+    door_checkpoint();
+}
 
-	SENSORS_DEACTIVATE(button_sensor);
-	PROCESS_END();
-	return 0;
+static void door_scene (msg_t* msg){
+    msg_t report;
+
+    scene_start(&scene, msg);
+    if (scene_advance(&scene, door_scene_step)){
+        report = scene_report(&scene);
+        outbox_put(&report);
+    }
+    door_checkpoint();
+    digest_later();
 }
 
-PROCESS_THREAD(temp_process, ev, data){
-	PROCESS_BEGIN();
+static void door_command (msg_t* msg){
+    msg_t reply;
 
-	static struct etimer sample_timer;
-	etimer_set(&sample_timer, SMPL_TEMP_PERIOD);
+    switch (msg->payload){
+        case ALARM_DISABLED:
+        case ALARM_ENABLED:
+            msg->payload = door_set_alarm((enum message) msg->payload);
+            outbox_put(msg);
+            digest_later();
+            door_checkpoint();
+            break;
 
-	while(true) {
-		PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&sample_timer));
-			SENSORS_ACTIVATE(sht11_sensor);
-			cqueue_insert(((sht11_sensor.value(SHT11_SENSOR_TEMP) / 10 - 396) / 10));
-			SENSORS_DEACTIVATE(sht11_sensor);
-			etimer_reset(&sample_timer);
-	}
-	PROCESS_END();
-	return 0;
+        case ENTRANCE_OPEN:
+            if (alarm_state == DISABLED && door_state == CLOSED){
+                door_start_opening((clock_time_t) msg->time);
+                digest_later();
+            }
+            break;
+
+        case GET_TEMP:
+            reply = set_message(TEMP_MSG, cqueue_avg(&temp_window));
+            reply.seq = msg->seq;
+            outbox_put(&reply);
+            break;
+
+        case HVAC_ON:
+        case HVAC_OFF:
+            door_hvac(msg);
+            break;
+
+        default:
+            // Commands unknown to this firmware go to the module loaded over
+            // the air, if any
+            if (ota_handle(msg)){
+                outbox_put(msg);
+            }
+            else {
+                BINLOG(LOG_UNKNOWN_PAYLOAD, msg->payload, 0);
+            }
+            break;
+    }
 }
 
 PROCESS_THREAD(msg_process, ev, data){
-    static struct etimer free_radio;
     static msg_t msg;
 
     PROCESS_EXITHANDLER(broadcast_close(&broadcast);)
     PROCESS_EXITHANDLER(runicast_close(&runicast);)
     PROCESS_BEGIN();
 
-    // Init
-    alarm_event = process_alloc_event();
-    start_opening = process_alloc_event();
-    get_temp = process_alloc_event();
+    // Init, the parameters first since the timers use them
+    param_init(PARAM_DOOR);
     message_from_cu = process_alloc_event();
+    duplicate_from_cu = process_alloc_event();
     broadcast_open(&broadcast, BC_CH, &broadcast_call);
     runicast_open(&runicast, RU_CH, &runicast_calls);
+    netsync_open(false);
+    ota_open();
+    binlog_open();
+    TRACE_OPEN();
+    wake_open();
+#if !KEEP_NODE_ADDR
     linkaddr_set_node_addr(&door_addr);
+#endif
+    outbox_open(msg2cu, &cu_addr);
+
+    alarm_state = DISABLED;
+    light_state = OFF;
+    previous_light_state = OFF;
+    door_state = CLOSED;
+    cqueue_init(&temp_window);
+    hvac_init(&hvac);
+    if (door_restore() && alarm_state == ENABLED){
+        alarm_start();
+    }
+    set_leds();
+
+    anomaly_init(&detector);
+#if HVAC_SIM
+    hvac_model_init(&room, HVAC_SETPOINT_DEFAULT - 500, HVAC_SETPOINT_DEFAULT - 1000);
+#endif
+    ctimer_set(&sample_timer, CLOCK_SECOND*ANOMALY_PERIOD_SECONDS, temp_sample, NULL);
+    digest_later();
+    ctimer_set(&keepalive_timer, DIGEST_PERIOD, keepalive, NULL);
+    SENSORS_ACTIVATE(button_sensor);
 
     while(true){
         PROCESS_WAIT_EVENT();
-        if (ev == send_msg){
-            msg = get_message_from(data);
-
-            // Can't define a stand alone function due to Contiki restriction
-            // on using PROCESS_WAIT_UNTIL macro
-            while(msg2cu(&msg) == 1){
-                // Wait a quarter of second before retry
-                etimer_set(&free_radio, CLOCK_SECOND >> 2);
-                PROCESS_WAIT_UNTIL(etimer_expired(&free_radio));
-                etimer_stop(&free_radio);
-            }
+        if (ev == sensors_event && data == &button_sensor){
+            previous_light_state = light_state;
+            light_state = (light_state == OFF) ? ON : OFF;
+            set_leds();
+            door_checkpoint();
+        }
+        else if (ev == serial_line_event_message && strcmp((char*) data, "heartbeat") == 0){
+            heartbeat_print();
         }
-        if (ev == message_from_cu){
+        else if (ev == duplicate_from_cu){
+            outbox_resend((uint8_t) (int) data);
+        }
+        else if (ev == message_from_cu){
             msg = get_message_from(data);
             if (msg.hdr == CMD_MSG){
-                switch (msg.payload){
-                    case ALARM_DISABLED:
-                    case ALARM_ENABLED:
-                        process_post(&main_process, alarm_event, (void*) &msg);
-                        break;
-
-                    case ENTRANCE_OPEN:
-                        process_post(&main_process, start_opening, NULL);
-                        break;
-
-                    case GET_TEMP:
-                        process_post(&main_process, get_temp, NULL);
-                        break;
-
-                    default:
-                        break;
-                }
+                door_command(&msg);
+            }
+            else if (msg.hdr == HVAC_MSG){
+                door_hvac(&msg);
+            }
+            else if (msg.hdr == SCENE_MSG){
+                door_scene(&msg);
+            }
+            else if (msg.hdr == PARAM_MSG){
+                param_handle(&msg);
+                outbox_put(&msg);
             }
         }
     }
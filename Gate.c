@@ -1,55 +1,108 @@
 #include "nesproj.h"
+#include "persist.h"
+#include "netsync.h"
+#include "fixmath.h"
+#include "otaload.h"
+#include "linkstats.h"
+#include "trace.h"
+#include "outbox.h"
+#include "wakes.h"
+#include "liveness.h"
+#include "binlog.h"
+#include "scene.h"
+#include "param.h"
 #include "dev/light-sensor.h"
 #include "sys/timer.h"
+#include "sys/ctimer.h"
+#include "dev/serial-line.h"
+
+// Groups this node belongs to, zones can be added at build time, e.g.
+// DEFINES=NODE_GROUPS=0x06 for a gate in zone 0
+#ifndef NODE_GROUPS
+#define NODE_GROUPS GROUP_GATE
+#endif
 
 // Custom event enqueued for this node
 static process_event_t message_from_cu;
-static process_event_t alarm_event;
-static process_event_t start_opening;
-static process_event_t end_opening;
-static process_event_t send_msg;
-static process_event_t lock_unlock_ev;
-static process_event_t get_light;
+static process_event_t duplicate_from_cu;
 
 // Node state
 enum lock_state lock_state;
 enum alarm_state alarm_state;
 enum entrance_state gate_state;
 
-linkaddr_t gate_addr = {{GATE_ADDR_0, GATE_ADDR_1}};
+// Scene being run
+static struct scene scene;
+
+// The opening goes through the synchronized start and the blinking on
+// open_timer
+static struct ctimer open_timer;
+static struct timer open_period;
+static struct ctimer alarm_timer;
+static struct ctimer sensor_timer;
+static struct ctimer digest_timer;
+static struct ctimer keepalive_timer;
+static uint8_t light_seq;
+
+static void alarm_start (void);
+static void alarm_stop (void);
+static void open_begin (void);
+static void open_start (void* ptr);
 
-PROCESS(msg_process, "Gate Node Message Manager Process");
-PROCESS(alarm_process, "Gate Node Alarm Process");
-PROCESS(openclose_process, "Gate Node Opening Process");
-PROCESS(main_process, "Gate Main Process");
+linkaddr_t gate_addr = {{GATE_ADDR_0, GATE_ADDR_1}};
+linkaddr_t cu_addr = {{CU_ADDR_0, CU_ADDR_1}};
 
-// Missing processes have to be spawned by other ones
-AUTOSTART_PROCESSES(&msg_process, &main_process);
+// A single process dispatches the messages of the CU, the blinking, the
+// opening, the light sampling and the digests are ctimer callbacks run in its
+// context
+PROCESS(msg_process, "Gate Node Dispatcher");
+AUTOSTART_PROCESSES(&msg_process);
 
 // For rime communication
 static struct broadcast_conn broadcast;
 static struct runicast_conn runicast;
 
+// Ignores messages from any node except for CU and commands for other
+// groups. A retransmitted command isn't run again, its reply is sent again
+// in case the first one has been lost
+static void from_cu (const linkaddr_t* from){
+    msg_t* msg = (msg_t*) packetbuf_dataptr();
+
+    switch (filter_from_cu(from, msg, NODE_GROUPS)){
+        case RX_ACCEPTED:
+            process_post(&msg_process, message_from_cu, msg);
+            break;
+
+        case RX_DUPLICATE:
+            process_post(&msg_process, duplicate_from_cu, (void*) (int) msg->seq);
+            break;
+
+        default:
+            break;
+    }
+}
+
 // Callbacks for Rime to work
 static void broadcast_recv (struct broadcast_conn *c, const linkaddr_t *from) {
-    // Ignores messages from any node except for CU
-	if (from->u8[0] == CU_ADDR_0 && from->u8[1] == CU_ADDR_1) {
-		process_post(&msg_process, message_from_cu, packetbuf_dataptr());
-	}
+    TRACE_RX(BC_CH, from);
+    link_stats_rx(from);
+    link_stats_beacon(from);
+    from_cu(from);
 }
 
 static void recv_runicast (struct runicast_conn *c, const linkaddr_t *from, uint8_t seqno){
-    if(from->u8[0] == CU_ADDR_0 && from->u8[1] == CU_ADDR_1) {
-		process_post(&msg_process, message_from_cu, packetbuf_dataptr());
-	}
+    TRACE_RX(RU_CH, from);
+    link_stats_rx(from);
+    from_cu(from);
 }
 
 static void sent_runicast (struct runicast_conn *c, const linkaddr_t *to, uint8_t retransmissions){
-    // Do nothing
+    link_stats_tx(to, retransmissions, true);
 }
 
 static void timedout_runicast (struct runicast_conn *c, const linkaddr_t *to, uint8_t retransmissions){
-    // Do nothing
+    link_stats_tx(to, retransmissions, false);
+    BINLOG(LOG_RUNICAST_TIMEOUT, BINLOG_ADDR(to), retransmissions);
 }
 
 // Data structure for the rime communication primitives
@@ -70,13 +123,121 @@ void set_leds (){
     }
 }
 
+// Node state written to flash and restored at boot
+struct gate_checkpoint {
+    uint8_t alarm;
+    uint8_t lock;
+};
+
+void gate_checkpoint (){
+    struct gate_checkpoint ckpt;
+
+    ckpt.alarm = alarm_state;
+    ckpt.lock = lock_state;
+    persist_store(&ckpt, sizeof(ckpt));
+}
+
+bool gate_restore (){
+    struct gate_checkpoint ckpt;
+
+    if (!persist_load(&ckpt, sizeof(ckpt))){
+        return false;
+    }
+
+    // The gate is closed after a reboot, so an alarm which was waiting for it
+    // to close is enabled now
+    alarm_state = (ckpt.alarm == DISABLED) ? DISABLED : ENABLED;
+    lock_state = (ckpt.lock == LOCKED) ? LOCKED : UNLOCKED;
+    return true;
+}
+
+// Commands carry the target state, so a command sent again with a new seq
+// leaves the node where it is and it is only acknowledged. Returns the state
+// to acknowledge
+enum message gate_set_alarm (enum message target){
+    if (target == ALARM_ENABLED){
+        if (gate_state == MOVING){
+            // The alarm is enabled once the entrance is closed
+            alarm_state = ENABLING;
+            return ALARM_ENABLING;
+        }
+        if (alarm_state != ENABLED){
+            alarm_start();
+            alarm_state = ENABLED;
+        }
+    }
+    else {
+        if (alarm_state == ENABLED){
+            alarm_stop();
+        }
+        alarm_state = DISABLED;
+    }
+    return target;
+}
+
+void gate_start_opening (clock_time_t at){
+    clock_time_t start_wait;
+
+    gate_state = MOVING;
+
+    // The entrances start moving together at the time given by the CU
+    start_wait = netsync_wait(at);
+    if (start_wait == 0){
+        open_begin();
+    }
+    else {
+        ctimer_set(&open_timer, start_wait, open_start, NULL);
+    }
+}
+
+enum scene_result gate_scene_step (enum message action, uint16_t time){
+    switch (action){
+        case ALARM_ENABLED:
+        case ALARM_DISABLED:
+            gate_set_alarm(action);
+            return SCENE_DONE;
+
+        case GATE_LOCK:
+        case GATE_UNLOCK:
+            if (gate_state == MOVING){
+                return SCENE_WAIT;
+            }
+            lock_state = (action == GATE_LOCK) ? LOCKED : UNLOCKED;
+            set_leds();
+            return SCENE_DONE;
+
+        case ENTRANCE_CLOSE:
+            return (gate_state == MOVING) ? SCENE_WAIT : SCENE_DONE;
+
+        case ENTRANCE_OPEN:
+            if (gate_state == MOVING){
+                return SCENE_WAIT;
+            }
+            if (lock_state != UNLOCKED || alarm_state != DISABLED){
+                return SCENE_FAILED;
+            }
+            gate_start_opening((clock_time_t) time);
+            return SCENE_DONE;
+
+        case HVAC_ON:
+        case HVAC_OFF:
+            return SCENE_SKIPPED;
+
+        default:
+            return SCENE_FAILED;
+    }
+}
+
 uint8_t msg2cu (msg_t *msg){
     if (!runicast_is_transmitting(&runicast)){
 		linkaddr_t recv;
+		msg->time = netsync_time();
 		packetbuf_copyfrom((void*) msg, sizeof(msg_t));
 		recv.u8[0] = CU_ADDR_0;
 		recv.u8[1] = CU_ADDR_1;
-		runicast_send(&runicast, &recv, MAX_RETRANSMISSIONS);
+		TRACE_TX(RU_CH, &recv);
+		runicast_send(&runicast, &recv, link_prepare(&recv));
+		heartbeat_sent();
 	}
     else {
         return 1;
@@ -84,201 +245,224 @@ uint8_t msg2cu (msg_t *msg){
     return 0;
 }
 
-PROCESS_THREAD(main_process, ev, data){
-    static msg_t msg;
-    static int32_t light_value;
-    static struct etimer sensor_timer;
-    PROCESS_BEGIN();
+// Blinks all the leds while the alarm is enabled
+static void alarm_blink (void* ptr){
+    WAKE_CALLBACK();
+    leds_toggle(LEDS_ALL);
+    ctimer_reset(&alarm_timer);
+}
 
-    // Init
-    linkaddr_set_node_addr(&gate_addr);
-    alarm_event = process_alloc_event();
-    start_opening = process_alloc_event();
-    end_opening = process_alloc_event();
-    send_msg = process_alloc_event();
-    alarm_state = DISABLED;
-    gate_state = CLOSED;
-    lock_state = UNLOCKED;
+static void alarm_start (){
+    leds_off(LEDS_ALL);
+    leds_toggle(LEDS_ALL);
+    ctimer_set(&alarm_timer, param_ticks(PARAM_BLINK_MS), alarm_blink, NULL);
+}
+
+static void alarm_stop (){
+    ctimer_stop(&alarm_timer);
+    leds_off(LEDS_ALL);
     set_leds();
+}
 
-    while (true){
-        PROCESS_WAIT_EVENT();
-        if (ev == alarm_event){
-            msg = get_message_from(data);
-            if (gate_state == MOVING){
-                if (msg.payload == ALARM_DISABLED){
-                    alarm_state = DISABLED;
-                }
-                else {
-                    // it can be only ALARM_ENABLED
-                    alarm_state = ENABLING;
-                    msg.payload = ALARM_ENABLING;
-                }
-            }
-            switch (alarm_state) {
-                case DISABLED:
-                    process_start(&alarm_process, NULL);
-                    msg.payload = ALARM_ENABLED;
-                    alarm_state = ENABLED;
-                    break;
-
-                case ENABLED:
-                    process_exit(&alarm_process);
-                    msg.payload = ALARM_DISABLED;
-                    alarm_state = DISABLED;
-                    leds_off(LEDS_ALL);
-                    set_leds();
-                    break;
-
-                case ENABLING:
-                    // There is no need to send a confirm to the cu because
-                    // it is sent after the alarm is enabled after the door is
-                    // close
-                    break;
-
-                default:
-                    printf("%s: Error. Unrecognized payload: %d", __func__, msg.payload);
-                    break;
-            }
-            process_post(&msg_process, send_msg, (void*) &msg);
-        }
-        if (ev == start_opening && gate_state == CLOSED &&
-                                   lock_state == UNLOCKED &&
-                                   alarm_state == DISABLED) {
-                gate_state = MOVING;
-                process_start(&openclose_process, NULL);
-        }
-        if (ev == end_opening){
-            gate_state = CLOSED;
-            msg.hdr = CMD_MSG;
-            msg.payload = ENTRANCE_CLOSE;
-            process_post(&msg_process, send_msg, (void*) &msg);
-            if (alarm_state == ENABLING){
-                alarm_state = ENABLED;
-                msg.payload = ALARM_ENABLED;
-                process_start(&alarm_process, NULL);
-                process_post(&msg_process, send_msg, (void*) &msg);
-            }
-        }
-        if (ev == get_light){
-            // Need to wait a while for the sensor to initialize
-            SENSORS_ACTIVATE(light_sensor);
-            etimer_set(&sensor_timer, CLOCK_SECOND/10);
-        }
-        if (ev == PROCESS_EVENT_TIMER && etimer_expired(&sensor_timer)){
-            // Sample the light and send it
-            light_value = 10*light_sensor.value(LIGHT_SENSOR_PHOTOSYNTHETIC)/7;
-            SENSORS_DEACTIVATE(light_sensor);
-            msg.hdr = LIGHT_MSG;
-            msg.payload = light_value;
-            process_post(&msg_process, send_msg, (void*) &msg);
-        }
-        if (ev == lock_unlock_ev && gate_state == CLOSED){
-            lock_state = (lock_state == LOCKED) ? UNLOCKED : LOCKED;
-            set_leds();
-        }
+// Digest after a state change, and as keepalive when nothing else has been
+// sent to the CU for DIGEST_PERIOD
+static void digest_put (){
+    msg_t digest = set_message(STATE_MSG, pack_digest(alarm_state, lock_state, gate_state, 0, OFF));
+    outbox_put(&digest);
+}
+
+static void keepalive (void* ptr){
+    WAKE_CALLBACK();
+    if (heartbeat_idle() < DIGEST_PERIOD){
+        ctimer_set(&keepalive_timer, DIGEST_PERIOD - heartbeat_idle(), keepalive, NULL);
+        return;
     }
+    heartbeat_keepalive();
+    digest_put();
+    ctimer_set(&keepalive_timer, DIGEST_PERIOD, keepalive, NULL);
+}
 
-    PROCESS_END();
-    return 0;
+static void digest_send (void* ptr){
+    WAKE_CALLBACK();
+    digest_put();
+    ctimer_set(&keepalive_timer, DIGEST_PERIOD, keepalive, NULL);
 }
 
-PROCESS_THREAD(openclose_process, ev, data){
-    static struct etimer blink_timer;
-    static struct timer blink_period;
+static void digest_later (){
+    ctimer_set(&digest_timer, DIGEST_DELAY, digest_send, NULL);
+}
 
-    PROCESS_BEGIN();
+static void open_end (){
+    msg_t msg = set_message(CMD_MSG, ENTRANCE_CLOSE);
+    msg_t report;
 
-    end_opening = process_alloc_event();
-    timer_set(&blink_period, CLOCK_SECOND*16);
+    gate_state = CLOSED;
+    outbox_put(&msg);
+    if (alarm_state == ENABLING){
+        alarm_state = ENABLED;
+        msg.payload = ALARM_ENABLED;
+        alarm_start();
+        outbox_put(&msg);
+        gate_checkpoint();
+    }
+    digest_later();
+
+    // Steps of a scene waiting for the entrance to close
+    if (scene_advance(&scene, gate_scene_step)){
+        report = scene_report(&scene);
+        outbox_put(&report);
+        gate_checkpoint();
+    }
+}
+
+static void open_blink (void* ptr){
+    WAKE_CALLBACK();
+    if (timer_expired(&open_period)){
+        leds_off(LEDS_BLUE);
+        open_end();
+        return;
+    }
+    leds_toggle(LEDS_BLUE);
+    ctimer_reset(&open_timer);
+}
+
+static void open_begin (){
+    timer_set(&open_period, param_ticks(PARAM_OPEN_SECONDS));
     leds_on(LEDS_BLUE);
+    ctimer_set(&open_timer, param_ticks(PARAM_BLINK_MS), open_blink, NULL);
+}
 
-    etimer_set(&blink_timer, BLINK_PERIOD);
-    do {
-        PROCESS_WAIT_EVENT();
-        if (etimer_expired(&blink_timer)){
-            etimer_restart(&blink_timer);
-            leds_toggle(LEDS_BLUE);
-        }
-    } while (timer_expired(&blink_period) == 0);
-    leds_off(LEDS_BLUE);
-    process_post(&main_process, end_opening, NULL);
-    PROCESS_END();
-    return 0;
+// Synchronized start reached
+static void open_start (void* ptr){
+    WAKE_CALLBACK();
+    open_begin();
 }
 
-PROCESS_THREAD(alarm_process, ev, data){
-    static struct etimer blink_period;
+// The light sensor needs a while to initialize before it is read
+static void light_sample (void* ptr){
+    msg_t msg;
 
-    PROCESS_BEGIN();
-    leds_off(LEDS_ALL);
-    etimer_set(&blink_period, BLINK_PERIOD);
-    while (true) {
-        leds_toggle(LEDS_ALL);
-        PROCESS_WAIT_EVENT();
-        if (etimer_expired(&blink_period)){
-            etimer_restart(&blink_period);
-        }
+    WAKE_CALLBACK();
+    msg = set_message(LIGHT_MSG, fix_light_lux(light_sensor.value(LIGHT_SENSOR_PHOTOSYNTHETIC)));
+    SENSORS_DEACTIVATE(light_sensor);
+    msg.seq = light_seq;
+    outbox_put(&msg);
+}
+
+static void gate_scene (msg_t* msg){
+    msg_t report;
+
+    scene_start(&scene, msg);
+    if (scene_advance(&scene, gate_scene_step)){
+        report = scene_report(&scene);
+        outbox_put(&report);
     }
+    gate_checkpoint();
+    digest_later();
+}
 
-    PROCESS_END();
-    return 0;
+static void gate_command (msg_t* msg){
+    switch (msg->payload){
+        case ALARM_ENABLED:
+        case ALARM_DISABLED:
+            msg->payload = gate_set_alarm((enum message) msg->payload);
+            outbox_put(msg);
+            digest_later();
+            gate_checkpoint();
+            break;
+
+        case ENTRANCE_OPEN:
+            if (gate_state == CLOSED && lock_state == UNLOCKED && alarm_state == DISABLED){
+                gate_start_opening((clock_time_t) msg->time);
+                digest_later();
+            }
+            break;
+
+        case GATE_LOCK:
+        case GATE_UNLOCK:
+            if (gate_state == CLOSED){
+                lock_state = (msg->payload == GATE_LOCK) ? LOCKED : UNLOCKED;
+                set_leds();
+                gate_checkpoint();
+                digest_later();
+            }
+            break;
+
+        case GET_LIGHT:
+            light_seq = msg->seq;
+            SENSORS_ACTIVATE(light_sensor);
+            ctimer_set(&sensor_timer, CLOCK_SECOND/10, light_sample, NULL);
+            break;
+
+        default:
+            // Commands unknown to this firmware go to the module loaded over
+            // the air, if any
+            if (ota_handle(msg)){
+                outbox_put(msg);
+            }
+            else {
+                BINLOG(LOG_UNKNOWN_PAYLOAD, msg->payload, 0);
+            }
+            break;
+    }
 }
 
 PROCESS_THREAD(msg_process, ev, data){
     static msg_t msg;
-    static struct timer free_radio;
 
     PROCESS_EXITHANDLER(broadcast_close(&broadcast);)
     PROCESS_EXITHANDLER(runicast_close(&runicast);)
     PROCESS_BEGIN();
 
-    // Init
-    alarm_event = process_alloc_event();
-    start_opening = process_alloc_event();
-    lock_unlock_ev = process_alloc_event();
+    // Init, the parameters first since the timers use them
+    param_init(PARAM_GATE);
+    message_from_cu = process_alloc_event();
+    duplicate_from_cu = process_alloc_event();
     broadcast_open(&broadcast, BC_CH, &broadcast_call);
     runicast_open(&runicast, RU_CH, &runicast_calls);
+    netsync_open(false);
+    ota_open();
+    binlog_open();
+    TRACE_OPEN();
+    wake_open();
+#if !KEEP_NODE_ADDR
     linkaddr_set_node_addr(&gate_addr);
+#endif
+    outbox_open(msg2cu, &cu_addr);
+
+    alarm_state = DISABLED;
+    gate_state = CLOSED;
+    lock_state = UNLOCKED;
+    if (gate_restore() && alarm_state == ENABLED){
+        alarm_start();
+    }
+    set_leds();
+    digest_later();
+    ctimer_set(&keepalive_timer, DIGEST_PERIOD, keepalive, NULL);
 
     while(true){
-        PROCESS_WAIT_EVENT();
-        msg = get_message_from(data);
-        if (ev == send_msg){
-            // Can't define a stand alone function due to Contiki restriction
-            // on using PROCESS_WAIT_UNTIL macro
-            // Wait a quarter of second before retry
-            timer_set(&free_radio, CLOCK_SECOND >> 2);
-            while(msg2cu(&msg) == 1){
-                PROCESS_WAIT_UNTIL(timer_expired(&free_radio));
-                timer_restart(&free_radio);
+        PROCESS_WAIT_EVENT_UNTIL(ev == message_from_cu || ev == duplicate_from_cu ||
+                                 ev == serial_line_event_message);
+        if (ev == serial_line_event_message){
+            if (strcmp((char*) data, "heartbeat") == 0){
+                heartbeat_print();
             }
+            continue;
         }
-        if (ev == message_from_cu){
-            if (msg.hdr == CMD_MSG){
-                switch (msg.payload){
-                    case ALARM_ENABLED:
-                    case ALARM_DISABLED:
-                        process_post(&main_process, alarm_event, (void*) &msg);
-                        break;
-
-                    case ENTRANCE_OPEN:
-                        process_post(&main_process, start_opening, NULL);
-                        break;
-
-                    case GATE_LOCK:
-                    case GATE_UNLOCK:
-                        process_post(&main_process, lock_unlock_ev, NULL);
-                        break;
-
-                    case GET_LIGHT:
-                        process_post(&main_process, get_light, NULL);
-                        break;
-
-                    default:
-                        break;
-                }
-            }
+        if (ev == duplicate_from_cu){
+            outbox_resend((uint8_t) (int) data);
+            continue;
+        }
+        msg = get_message_from(data);
+        if (msg.hdr == CMD_MSG){
+            gate_command(&msg);
+        }
+        else if (msg.hdr == SCENE_MSG){
+            gate_scene(&msg);
+        }
+        else if (msg.hdr == PARAM_MSG){
+            param_handle(&msg);
+            outbox_put(&msg);
         }
     }
 
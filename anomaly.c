@@ -0,0 +1,42 @@
+#include "anomaly.h"
+
+#define RATE_ON     ((int32_t) ANOMALY_RATE << ANOMALY_FRAC)
+#define JUMP_ON     ((int32_t) ANOMALY_JUMP << ANOMALY_FRAC)
+
+void anomaly_init (struct anomaly* a){
+    a->level = 0;
+    a->trend = 0;
+    a->prev = 0;
+    a->warmup = 0;
+    a->raised = false;
+}
+
+enum anomaly_event anomaly_update (struct anomaly* a, int centi){
+    int32_t x = (int32_t) centi << ANOMALY_FRAC;
+
+    if (a->warmup == 0){
+        a->level = x;
+        a->prev = x;
+        a->trend = 0;
+    }
+    a->trend += ((x - a->prev) - a->trend) >> ANOMALY_TREND_SHIFT;
+    a->level += (x - a->level) >> ANOMALY_LEVEL_SHIFT;
+    a->prev = x;
+
+    if (a->warmup < ANOMALY_WARMUP){
+        ++a->warmup;
+        return ANOMALY_NONE;
+    }
+
+    // Raised on a fast rise or a step, cleared with hysteresis when both are
+    // back under half their threshold
+    if (!a->raised && (a->trend > RATE_ON || x - a->level > JUMP_ON)){
+        a->raised = true;
+        return ANOMALY_RAISED;
+    }
+    if (a->raised && a->trend < RATE_ON / 2 && x - a->level < JUMP_ON / 2){
+        a->raised = false;
+        return ANOMALY_CLEARED;
+    }
+    return ANOMALY_NONE;
+}
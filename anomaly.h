@@ -0,0 +1,49 @@
+/**
+Detector of fast temperature changes run by the Door on every sample. It keeps
+an EWMA of the temperature and one of its change between samples, in fixed
+point, and reports when the change rate or the distance from the average go
+over a threshold. It depends only on nesproj.h (see bench/)
+**/
+#ifndef ANOMALY_H_
+#define ANOMALY_H_  1
+
+#include "nesproj.h"
+
+// The detector samples faster than the averaging window, which takes one
+// sample every SMPL_TEMP_PERIOD_SECONDS (a multiple of this)
+#define ANOMALY_PERIOD_SECONDS  2
+
+// Fraction bits of the averages and their weights, 1/2^shift
+#define ANOMALY_FRAC        4
+#define ANOMALY_LEVEL_SHIFT 3
+#define ANOMALY_TREND_SHIFT 1
+
+// Thresholds in hundredths of degree: rise between two samples (0.15 degrees
+// every 2 s is 4.5 degrees a minute) and distance from the average
+#ifndef ANOMALY_RATE
+#define ANOMALY_RATE    15
+#endif
+#ifndef ANOMALY_JUMP
+#define ANOMALY_JUMP    300
+#endif
+
+// Samples needed before the averages are trusted
+#define ANOMALY_WARMUP  4
+
+struct anomaly {
+    int32_t level;  // EWMA of the temperature
+    int32_t trend;  // EWMA of the change between samples
+    int32_t prev;
+    uint8_t warmup;
+    bool raised;
+};
+
+enum anomaly_event {
+    ANOMALY_NONE,
+    ANOMALY_RAISED,
+    ANOMALY_CLEARED
+};
+
+void anomaly_init (struct anomaly* a);
+enum anomaly_event anomaly_update (struct anomaly* a, int centi);
+#endif
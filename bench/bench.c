@@ -0,0 +1,406 @@
+/**
+Host side microbenchmarks of the node independent logic: message decoding and
+duplicate suppression, the temperature window and the anomaly detector of the
+Door, the HVAC controller, the command check and the reading history of the
+CU, the single flight of its sensor requests, the link impairment decisions
+and the fixed point conversions next to the divisions they replaced. Every
+benchmark reports ns/op and, where perf events are available, instructions/op,
+and fails when one exceeds its threshold. Before timing, the fixed point
+conversions are checked against the original expressions over their whole
+input range.
+
+    make -C bench run
+    bench/bench -n 2000000 -s 2    (iterations, threshold scale)
+**/
+#define _GNU_SOURCE
+#include "nesproj.h"
+#include "cqueue.h"
+#include "command.h"
+#include "anomaly.h"
+#include "history.h"
+#include "hvac.h"
+#include "inflight.h"
+#include "impair.h"
+#include "fixmath.h"
+
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#define DEFAULT_ITERATIONS  1000000UL
+
+struct bench {
+    const char* name;
+    void (*run) (unsigned long n);
+    // Regression thresholds, per operation. The instruction counts are stable
+    // on a given compiler, the times are loose to survive a loaded machine
+    double max_ns;
+    double max_insns;
+};
+
+// Results are accumulated here so the compiler can't drop the work
+static volatile int sink;
+
+// Frames as they come out of packetbuf on the CU, a mix of replies, digests
+// and retransmitted commands from a few senders
+#define FRAME_NUM   8
+static msg_t frames[FRAME_NUM];
+static linkaddr_t senders[FRAME_NUM];
+
+static void frames_init (void){
+    uint8_t i;
+    for (i = 0; i < FRAME_NUM; ++i){
+        frames[i] = set_message(i & 1 ? TEMP_MSG : CMD_MSG, 2000 + i);
+        set_seq(&frames[i], (i >> 1) + 1);
+        set_group(&frames[i], (i & 3) ? GROUP_ALL : GROUP_GATE);
+        senders[i].u8[0] = (i % 3) + 1;
+        senders[i].u8[1] = 0;
+    }
+    frames[5] = set_message(STATE_MSG, pack_digest(ENABLED, LOCKED, MOVING, SMPL_NUM, ON));
+}
+
+static void bench_decode (unsigned long n){
+    unsigned long i;
+    int acc = 0;
+    msg_t msg;
+
+    for (i = 0; i < n; ++i){
+        uint8_t k = i % FRAME_NUM;
+        if (!in_group(&frames[k], GROUP_DOOR) || is_duplicate(&senders[k], frames[k].seq)){
+            continue;
+        }
+        msg = get_message_from(&frames[k]);
+        switch (get_header(&msg)){
+            case STATE_MSG:
+                acc += DIGEST_ALARM(msg.payload) + DIGEST_FILL(msg.payload);
+                break;
+            case TEMP_MSG:
+                acc += get_payload(&msg);
+                break;
+            default:
+                acc += get_seq(&msg);
+                break;
+        }
+    }
+    sink = acc;
+}
+
+static void bench_encode (unsigned long n){
+    unsigned long i;
+    int acc = 0;
+    msg_t msg;
+
+    for (i = 0; i < n; ++i){
+        msg = set_message(STATE_MSG, pack_digest(i & 1 ? ENABLED : DISABLED,
+                                                 LOCKED, CLOSED, i % 16, OFF));
+        set_seq(&msg, (uint8_t) i);
+        acc += msg.payload;
+    }
+    sink = acc;
+}
+
+static void bench_cqueue (unsigned long n){
+    static struct cqueue q;
+    unsigned long i;
+    int acc = 0;
+
+    cqueue_init(&q);
+    for (i = 0; i < n; ++i){
+        cqueue_insert(&q, 2000 + (int) (i & 0xFF));
+        acc += cqueue_avg(&q);
+    }
+    sink = acc;
+}
+
+static void bench_detect (unsigned long n){
+    static struct anomaly a;
+    unsigned long i;
+    int acc = 0;
+
+    anomaly_init(&a);
+    for (i = 0; i < n; ++i){
+        // Slow saw tooth with a fast rise every 256 samples
+        acc += anomaly_update(&a, 2000 + (int) (i & 0xFF) * ((i & 0x100) ? 8 : 1));
+    }
+    sink = acc;
+}
+
+static void bench_control (unsigned long n){
+    static struct hvac c;
+    static struct hvac_model m;
+    unsigned long i;
+    int temp = 1600;
+
+    hvac_init(&c);
+    hvac_set_on(&c, true);
+    hvac_model_init(&m, temp, 1000);
+    for (i = 0; i < n; ++i){
+        // A new setpoint every hour of simulated time keeps the loop moving
+        if (i % 1800 == 0){
+            hvac_set_point(&c, (i / 1800) & 1 ? 1800 : 2400);
+        }
+        temp = hvac_model_step(&m, hvac_step(&c, temp));
+    }
+    sink = temp;
+}
+
+static void bench_append (unsigned long n){
+    linkaddr_t node = {{DOOR_ADDR_0, DOOR_ADDR_1}};
+    struct history* h = history_series(&node, TEMP_MSG);
+    struct history_stats stats;
+    unsigned long i;
+
+    for (i = 0; i < n; ++i){
+        history_append(h, i * 60, 2000 + (int) (i % 37) - 18);
+    }
+    history_query(h, 0, n * 60, &stats);
+    sink = stats.avg;
+}
+
+static void bench_dispatch (unsigned long n){
+    struct cu_view view;
+    enum message out = GET_TEMP;
+    unsigned long i;
+    int acc = 0;
+
+    for (i = 0; i < n; ++i){
+        view.alarm = (i >> 3) % 3;
+        view.entrance = (i >> 5) & 1;
+        view.lock = (i >> 6) % 3;
+        view.hvac = (i >> 8) & 1 ? ON : OFF;
+        acc += command_check((enum user_command) (i % (COMMAND_NUMBER + 1)), &view, &out);
+        acc += out;
+    }
+    sink = acc;
+}
+
+static void bench_coalesce (unsigned long n){
+    linkaddr_t door = {{DOOR_ADDR_0, DOOR_ADDR_1}};
+    linkaddr_t gate = {{GATE_ADDR_0, GATE_ADDR_1}};
+    unsigned long i;
+    int acc = 0;
+
+    inflight_init();
+    for (i = 0; i < n; ++i){
+        // Eight requests a second, alternating the sensors, and a reply every
+        // sixteen of them
+        acc += inflight_request((i & 1) ? &gate : &door, (i & 1) ? LIGHT_MSG : TEMP_MSG, i / 8);
+        if ((i & 0xF) >= 14){
+            acc += inflight_complete((i & 1) ? &gate : &door, (i & 1) ? LIGHT_MSG : TEMP_MSG);
+        }
+    }
+    sink = acc + inflight_get_stats()->sent;
+}
+
+static void bench_impair (unsigned long n){
+    static struct impair im;
+    struct impair_conf conf;
+    uint16_t delay[IMPAIR_COPIES];
+    unsigned long i;
+    int acc = 0;
+
+    // Bursty loss with every other impairment on, the worst case per frame
+    impair_default_conf(&conf);
+    conf.model = IMPAIR_GILBERT;
+    conf.loss = 500;
+    conf.loss_good = 20;
+    conf.jitter = 40;
+    conf.dup = 50;
+    conf.reorder = 50;
+    impair_init(&im, &conf, 3);
+    for (i = 0; i < n; ++i){
+        uint8_t copies = impair_frame(&im, delay);
+        acc += copies ? copies + delay[0] : 0;
+    }
+    sink = acc + im.stats.dropped;
+}
+
+// Sums in the range of a window of 16 bit samples, the divisor goes through
+// the table sizes
+static void bench_fixdiv (unsigned long n){
+    unsigned long i;
+    int acc = 0;
+
+    for (i = 0; i < n; ++i){
+        acc += fix_div((int32_t) ((i * 40503UL) & 0xFFFF) - 0x8000, (i & 0xF) + 1);
+    }
+    sink = acc;
+}
+
+// The division fix_div() replaced, the same operands
+static void bench_cdiv (unsigned long n){
+    unsigned long i;
+    int acc = 0;
+
+    for (i = 0; i < n; ++i){
+        acc += ((int32_t) ((i * 40503UL) & 0xFFFF) - 0x8000) / (int32_t) ((i & 0xF) + 1);
+    }
+    sink = acc;
+}
+
+static void bench_fixlux (unsigned long n){
+    unsigned long i;
+    int acc = 0;
+
+    for (i = 0; i < n; ++i){
+        acc += fix_light_lux((uint16_t) i);
+    }
+    sink = acc;
+}
+
+// 10*raw/7 of the Gate before fixmath, in 32 bits since the 16 bit one of the
+// Sky overflows past raw 3276
+static void bench_clux (unsigned long n){
+    unsigned long i;
+    int acc = 0;
+
+    for (i = 0; i < n; ++i){
+        acc += (int) (10 * (int32_t) (uint16_t) i / 7);
+    }
+    sink = acc;
+}
+
+// fix_div() against the C division for every divisor of the table over the
+// range of its fast path and a bit past it, and fix_light_lux() for every raw
+// value. Returns the number of mismatches
+static unsigned long fix_check (void){
+    unsigned long bad = 0;
+    int32_t x;
+    uint32_t raw;
+    uint8_t d;
+
+    for (d = 1; d <= FIX_RECIP_MAX; ++d){
+        for (x = -65535L * d - 16; x < 65535L * d + 16; ++x){
+            if (fix_div(x, d) != (int) (x / d)){
+                if (bad++ == 0){
+                    printf("fix_div(%ld, %u) = %d, expected %ld\n", (long) x, d,
+                           fix_div(x, d), (long) (x / d));
+                }
+            }
+        }
+    }
+    for (raw = 0; raw <= 0xFFFF; ++raw){
+        if (fix_light_lux(raw) != (int) (10 * (int32_t) raw / 7)){
+            if (bad++ == 0){
+                printf("fix_light_lux(%lu) = %d, expected %ld\n", (unsigned long) raw,
+                       fix_light_lux(raw), (long) (10 * (int32_t) raw / 7));
+            }
+        }
+    }
+    return bad;
+}
+
+static const struct bench benches[] = {
+    {"decode",      bench_decode,   60.0,   150.0},
+    {"encode",      bench_encode,   30.0,    60.0},
+    {"cqueue",      bench_cqueue,   60.0,   120.0},
+    {"detect",      bench_detect,   30.0,    60.0},
+    {"control",     bench_control,  30.0,    80.0},
+    {"append",      bench_append,   60.0,   150.0},
+    {"dispatch",    bench_dispatch, 40.0,    80.0},
+    {"coalesce",    bench_coalesce, 40.0,   100.0},
+    {"impair",      bench_impair,   40.0,   120.0},
+    {"fixdiv",      bench_fixdiv,   20.0,    60.0},
+    {"cdiv",        bench_cdiv,     20.0,    60.0},
+    {"fixlux",      bench_fixlux,   20.0,    60.0},
+    {"clux",        bench_clux,     20.0,    60.0},
+};
+
+static int perf_fd = -1;
+
+static void perf_open (void){
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    perf_fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static double now_ns (void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int main (int argc, char** argv){
+    unsigned long n = DEFAULT_ITERATIONS;
+    double scale = 1.0;
+    int failed = 0;
+    unsigned long bad;
+    int opt;
+    size_t i;
+
+    while ((opt = getopt(argc, argv, "n:s:")) != -1){
+        switch (opt){
+            case 'n':
+                n = strtoul(optarg, NULL, 10);
+                break;
+            case 's':
+                scale = atof(optarg);
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-n iterations] [-s threshold scale]\n", argv[0]);
+                return 2;
+        }
+    }
+    if (n == 0 || scale <= 0){
+        fprintf(stderr, "invalid iterations or scale\n");
+        return 2;
+    }
+
+    frames_init();
+    bad = fix_check();
+    printf("fixmath: %lu mismatches against the C division\n", bad);
+    if (bad != 0){
+        return 1;
+    }
+    perf_open();
+    if (perf_fd < 0){
+        printf("perf events not available, instruction counts skipped\n");
+    }
+
+    printf("%-10s %10s %10s %12s %10s\n", "bench", "ns/op", "max", "insns/op", "max");
+    for (i = 0; i < sizeof(benches) / sizeof(benches[0]); ++i){
+        const struct bench* b = &benches[i];
+        long long insns = 0;
+        double ns, start;
+        bool over;
+
+        // Warm up caches and branch predictors
+        b->run(n / 10 + 1);
+
+        if (perf_fd >= 0){
+            ioctl(perf_fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(perf_fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+        start = now_ns();
+        b->run(n);
+        ns = (now_ns() - start) / n;
+        if (perf_fd >= 0){
+            ioctl(perf_fd, PERF_EVENT_IOC_DISABLE, 0);
+            if (read(perf_fd, &insns, sizeof(insns)) != sizeof(insns)){
+                insns = 0;
+            }
+        }
+
+        over = ns > b->max_ns * scale;
+        if (perf_fd >= 0){
+            over = over || (double) insns / n > b->max_insns * scale;
+            printf("%-10s %10.2f %10.1f %12.1f %10.1f%s\n", b->name, ns, b->max_ns * scale,
+                   (double) insns / n, b->max_insns * scale, over ? "  REGRESSION" : "");
+        }
+        else {
+            printf("%-10s %10.2f %10.1f %12s %10s%s\n", b->name, ns, b->max_ns * scale,
+                   "-", "-", over ? "  REGRESSION" : "");
+        }
+        failed |= over;
+    }
+    return failed ? 1 : 0;
+}
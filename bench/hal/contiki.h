@@ -0,0 +1,16 @@
+/**
+Host side stand-in of the few Contiki declarations the node independent
+modules need (nesproj.c, cqueue.c, command.c, fixmath.c). Nothing here runs on
+the motes, it only lets those files build as plain C on Linux
+**/
+#ifndef BENCH_CONTIKI_H_
+#define BENCH_CONTIKI_H_  1
+
+#include <stdint.h>
+
+typedef unsigned short clock_time_t;
+#define CLOCK_SECOND    128
+
+typedef unsigned char process_event_t;
+typedef void* process_data_t;
+#endif
@@ -0,0 +1 @@
+// Not needed by the host build
@@ -0,0 +1,12 @@
+#include "net/linkaddr.h"
+#include <string.h>
+
+const linkaddr_t linkaddr_null = {{0, 0}};
+
+int linkaddr_cmp (const linkaddr_t* a, const linkaddr_t* b){
+    return memcmp(a, b, LINKADDR_SIZE) == 0;
+}
+
+void linkaddr_copy (linkaddr_t* dest, const linkaddr_t* src){
+    memcpy(dest, src, LINKADDR_SIZE);
+}
@@ -0,0 +1,17 @@
+#ifndef BENCH_LINKADDR_H_
+#define BENCH_LINKADDR_H_  1
+
+#include <stdint.h>
+
+#define LINKADDR_SIZE   2
+
+typedef union {
+    unsigned char u8[LINKADDR_SIZE];
+    uint16_t u16;
+} linkaddr_t;
+
+extern const linkaddr_t linkaddr_null;
+
+int linkaddr_cmp (const linkaddr_t* a, const linkaddr_t* b);
+void linkaddr_copy (linkaddr_t* dest, const linkaddr_t* src);
+#endif
@@ -0,0 +1,95 @@
+/**
+Step response of the Door HVAC controller on the room model of hvac.h, the
+same code the Door runs with HVAC_SIM=1. It prints rise time (10% to 90% of
+the step), overshoot, settling time (within 0.2 degrees) and steady state
+error, with -v also the temperature and power of every control period.
+
+    make -C bench step
+    bench/hvac_step -t 1500 -o 1000 -s 2100 -d 3600 -v
+**/
+#include "hvac.h"
+
+#include <unistd.h>
+
+#define SETTLE_BAND     20
+
+int main (int argc, char** argv){
+    struct hvac c;
+    struct hvac_model m;
+    int start = HVAC_SETPOINT_DEFAULT - 500;
+    int outside = HVAC_SETPOINT_DEFAULT - 1000;
+    int setpoint = HVAC_SETPOINT_DEFAULT;
+    long duration = 3600;
+    bool verbose = false;
+    long rise_lo = -1, rise_hi = -1, settle = -1;
+    int peak, temp, done, opt;
+    long t;
+
+    while ((opt = getopt(argc, argv, "t:o:s:d:v")) != -1){
+        switch (opt){
+            case 't':
+                start = atoi(optarg);
+                break;
+            case 'o':
+                outside = atoi(optarg);
+                break;
+            case 's':
+                setpoint = atoi(optarg);
+                break;
+            case 'd':
+                duration = atol(optarg);
+                break;
+            case 'v':
+                verbose = true;
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-t start] [-o outside] [-s setpoint] "
+                                "[-d seconds] [-v]\n", argv[0]);
+                return 2;
+        }
+    }
+
+    hvac_init(&c);
+    if (!hvac_set_point(&c, setpoint) || start == setpoint){
+        fprintf(stderr, "invalid setpoint\n");
+        return 2;
+    }
+    hvac_set_on(&c, true);
+    hvac_model_init(&m, start, outside);
+
+    temp = start;
+    peak = start;
+    for (t = 0; t < duration; t += HVAC_PERIOD_SECONDS){
+        hvac_step(&c, temp);
+        temp = hvac_model_step(&m, c.output);
+        if (verbose){
+            printf("%ld %d %d\n", t, temp, c.output);
+        }
+
+        // Step normalized to 0..100, it works for heating and cooling
+        done = (int) (100L * (temp - start) / (setpoint - start));
+        if (rise_lo < 0 && done >= 10){
+            rise_lo = t;
+        }
+        if (rise_hi < 0 && done >= 90){
+            rise_hi = t;
+        }
+        if ((setpoint > start) ? temp > peak : temp < peak){
+            peak = temp;
+        }
+        if (abs(temp - setpoint) > SETTLE_BAND){
+            settle = -1;
+        }
+        else if (settle < 0){
+            settle = t;
+        }
+    }
+
+    printf("step %d -> %d, outside %d\n", start, setpoint, outside);
+    printf("rise time %ld s\n", (rise_lo >= 0 && rise_hi >= 0) ? rise_hi - rise_lo : -1);
+    printf("overshoot %d\n", abs(peak - setpoint) * ((setpoint > start) ? peak > setpoint
+                                                                        : peak < setpoint));
+    printf("settling time %ld s\n", settle);
+    printf("steady state error %d\n", temp - setpoint);
+    return settle < 0 ? 1 : 0;
+}
@@ -0,0 +1,302 @@
+/**
+Replay of a radio trace (trace.h) on the host build of the node logic. The
+frames of one node are fed back in their order to the receive path it runs on
+the mote, the sender, group and duplicate checks of the actuators or the
+single flight of the sensor requests of the CU, and the request latencies are
+measured on the trace times: a command sent to a reply received on the CU, a
+command received to its reply sent on the actuators. The summary only depends
+on the trace, so two builds can be compared on it; -r repeats the replay to
+time it.
+
+    make -C bench replay
+    bench/replay -n 3.0 cu.log
+    bench/replay -n 1.0 -g 0x05 -r 1000 door.log
+**/
+#define _GNU_SOURCE
+#include "nesproj.h"
+#include "inflight.h"
+
+#include <time.h>
+#include <unistd.h>
+
+#define CHANNEL_BC  129
+#define CHANNEL_RU  144
+
+// Frames of a replay and requests waiting for their reply
+#define MAX_FRAMES  20000
+#define PENDING_LEN 16
+
+struct frame {
+    unsigned long ms;
+    bool sent;
+    linkaddr_t peer;
+    msg_t msg;
+};
+
+struct pending {
+    uint8_t seq;
+    linkaddr_t peer;
+    unsigned long ms;
+    bool used;
+};
+
+struct summary {
+    unsigned long frames;
+    unsigned long accepted;
+    unsigned long foreign;      // not from the CU or for other groups
+    unsigned long duplicates;
+    unsigned long requests;     // sensor requests the single flight would send
+    unsigned long diverged;     // requests sent in the trace the replay would hold
+    unsigned long latencies;
+    unsigned long latency_sum;
+    unsigned long latency_max;
+    unsigned long unanswered;
+};
+
+static struct frame frames[MAX_FRAMES];
+static unsigned long frame_num;
+static struct pending pending[PENDING_LEN];
+static uint8_t pending_victim;
+
+static bool is_cu;
+static uint8_t node_groups;
+
+static bool load (const char* path, const linkaddr_t* node){
+    FILE* f = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+    char line[256];
+    char hex[2 * 64 + 1];
+
+    if (f == NULL){
+        perror(path);
+        return false;
+    }
+    while (fgets(line, sizeof(line), f) != NULL && frame_num < MAX_FRAMES){
+        const char* rec = strstr(line, "#F ");
+        unsigned long seconds;
+        unsigned int ms, channel, len, i;
+        int self[2], peer[2];
+        char dir;
+        struct frame* fr = &frames[frame_num];
+        uint8_t raw[sizeof(msg_t)];
+
+        if (rec == NULL ||
+            sscanf(rec, "#F %lu %u %c %u %d.%d %d.%d %u %128s", &seconds, &ms, &dir, &channel,
+                   &self[0], &self[1], &peer[0], &peer[1], &len, hex) != 10){
+            continue;
+        }
+        // Frames of the node on the command channels, OTA and sync are not
+        // replayed
+        if (self[0] != node->u8[0] || self[1] != node->u8[1] ||
+            (channel != CHANNEL_BC && channel != CHANNEL_RU) ||
+            len < sizeof(msg_t) - 1 || strlen(hex) < 2 * (sizeof(msg_t) - 1)){
+            continue;
+        }
+        memset(raw, 0, sizeof(raw));
+        for (i = 0; i < sizeof(raw) && 2 * i + 1 < strlen(hex); ++i){
+            unsigned int byte;
+            sscanf(hex + 2 * i, "%2x", &byte);
+            raw[i] = byte;
+        }
+        // The layout of msg_t on the MSP430, little endian and packed
+        fr->msg.hdr = raw[0];
+        fr->msg.seq = raw[1];
+        fr->msg.payload = raw[2] | (raw[3] << 8);
+        fr->msg.time = raw[4] | (raw[5] << 8);
+        fr->msg.group = raw[6];
+        fr->ms = seconds * 1000 + ms;
+        fr->sent = dir == 't';
+        fr->peer.u8[0] = peer[0];
+        fr->peer.u8[1] = peer[1];
+        ++frame_num;
+    }
+    if (f != stdin){
+        fclose(f);
+    }
+    return true;
+}
+
+// Returns false for a retransmission, its latency counts from the first one
+static bool pending_add (const struct frame* fr){
+    uint8_t i;
+
+    for (i = 0; i < PENDING_LEN; ++i){
+        if (pending[i].used && pending[i].seq == fr->msg.seq &&
+            linkaddr_cmp(&pending[i].peer, &fr->peer)){
+            return false;
+        }
+    }
+    for (i = 0; i < PENDING_LEN && pending[i].used; ++i);
+    if (i == PENDING_LEN){
+        i = pending_victim;
+        pending_victim = (pending_victim + 1) % PENDING_LEN;
+    }
+    pending[i].seq = fr->msg.seq;
+    linkaddr_copy(&pending[i].peer, &fr->peer);
+    pending[i].ms = fr->ms;
+    pending[i].used = true;
+    return true;
+}
+
+static void pending_done (const struct frame* fr, struct summary* s){
+    unsigned long latency;
+    uint8_t i;
+
+    for (i = 0; i < PENDING_LEN; ++i){
+        if (pending[i].used && pending[i].seq == fr->msg.seq &&
+            (linkaddr_cmp(&pending[i].peer, &fr->peer) ||
+             linkaddr_cmp(&pending[i].peer, &linkaddr_null))){
+            latency = fr->ms - pending[i].ms;
+            s->latency_sum += latency;
+            if (latency > s->latency_max){
+                s->latency_max = latency;
+            }
+            ++s->latencies;
+            pending[i].used = false;
+            return;
+        }
+    }
+}
+
+static void replay_cu (const struct frame* fr, struct summary* s){
+    linkaddr_t node = fr->peer;
+    uint8_t sensor;
+
+    if (fr->sent){
+        if (fr->msg.hdr != CMD_MSG || fr->msg.seq == 0 || !pending_add(fr) ||
+            (fr->msg.payload != GET_TEMP && fr->msg.payload != GET_LIGHT)){
+            return;
+        }
+        sensor = (fr->msg.payload == GET_TEMP) ? TEMP_MSG : LIGHT_MSG;
+        if (inflight_request(&node, sensor, fr->ms / 1000)){
+            ++s->requests;
+        }
+        else {
+            ++s->diverged;
+        }
+        return;
+    }
+    ++s->accepted;
+    if (fr->msg.seq != 0){
+        pending_done(fr, s);
+    }
+    if (fr->msg.hdr == TEMP_MSG || fr->msg.hdr == LIGHT_MSG){
+        inflight_complete(&node, fr->msg.hdr);
+    }
+}
+
+static void replay_actuator (const struct frame* fr, struct summary* s){
+    if (fr->sent){
+        if (fr->msg.seq != 0){
+            pending_done(fr, s);
+        }
+        return;
+    }
+    // The receive filter of Door.c and Gate.c
+    switch (filter_from_cu(&fr->peer, &fr->msg, node_groups)){
+        case RX_FOREIGN:
+            ++s->foreign;
+            return;
+
+        case RX_DUPLICATE:
+            ++s->duplicates;
+            return;
+
+        default:
+            break;
+    }
+    ++s->accepted;
+    if (fr->msg.seq != 0){
+        pending_add(fr);
+    }
+}
+
+static void replay (struct summary* s){
+    unsigned long i;
+
+    memset(s, 0, sizeof(*s));
+    memset(pending, 0, sizeof(pending));
+    inflight_init();
+    dedup_reset();
+    for (i = 0; i < frame_num; ++i){
+        ++s->frames;
+        if (is_cu){
+            replay_cu(&frames[i], s);
+        }
+        else {
+            replay_actuator(&frames[i], s);
+        }
+    }
+    for (i = 0; i < PENDING_LEN; ++i){
+        s->unanswered += pending[i].used;
+    }
+}
+
+static double now_ns (void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int main (int argc, char** argv){
+    linkaddr_t node = {{CU_ADDR_0, CU_ADDR_1}};
+    struct summary s;
+    unsigned long rounds = 1;
+    unsigned long r;
+    int a, b;
+    double start;
+    int opt;
+
+    node_groups = 0;
+    while ((opt = getopt(argc, argv, "n:g:r:")) != -1){
+        switch (opt){
+            case 'n':
+                if (sscanf(optarg, "%d.%d", &a, &b) != 2){
+                    fprintf(stderr, "node address as a.b\n");
+                    return 2;
+                }
+                node.u8[0] = a;
+                node.u8[1] = b;
+                break;
+            case 'g':
+                node_groups = strtoul(optarg, NULL, 0);
+                break;
+            case 'r':
+                rounds = strtoul(optarg, NULL, 10);
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-n node] [-g groups] [-r rounds] trace\n", argv[0]);
+                return 2;
+        }
+    }
+    if (optind != argc - 1 || rounds == 0 || !load(argv[optind], &node)){
+        fprintf(stderr, "usage: %s [-n node] [-g groups] [-r rounds] trace\n", argv[0]);
+        return 2;
+    }
+
+    is_cu = node.u8[0] == CU_ADDR_0 && node.u8[1] == CU_ADDR_1;
+    if (node_groups == 0){
+        // The default NODE_GROUPS of Door.c and Gate.c
+        node_groups = (node.u8[0] == DOOR_ADDR_0 && node.u8[1] == DOOR_ADDR_1) ? GROUP_DOOR : GROUP_GATE;
+    }
+
+    replay(&s);
+    printf("node %d.%d (%s), %lu frames\n", node.u8[0], node.u8[1],
+           is_cu ? "cu" : "actuator", s.frames);
+    if (is_cu){
+        printf("received %lu, requests %lu, diverged %lu\n", s.accepted, s.requests, s.diverged);
+    }
+    else {
+        printf("accepted %lu, foreign %lu, duplicates %lu\n", s.accepted, s.foreign, s.duplicates);
+    }
+    printf("latency %lu requests, avg %lu max %lu ms, %lu unanswered\n", s.latencies,
+           s.latencies ? s.latency_sum / s.latencies : 0, s.latency_max, s.unanswered);
+
+    if (rounds > 1){
+        start = now_ns();
+        for (r = 0; r < rounds; ++r){
+            replay(&s);
+        }
+        printf("%.1f ns/frame over %lu rounds\n", (now_ns() - start) / (rounds * frame_num + 1), rounds);
+    }
+    return 0;
+}
@@ -0,0 +1,14 @@
+/**
+Records of the binary log. Only the record number and its two arguments go on
+the serial line, the format strings stay here for tools/binlog-decode.py and
+never reach the firmware. New records go at the end, so that old logs still
+decode
+**/
+BINLOG_ID(LOG_DROPPED,          "Log: %d records dropped, ring full")
+BINLOG_ID(LOG_UNKNOWN_PAYLOAD,  "msg_process: Error. Unrecognized command: %d")
+BINLOG_ID(LOG_UNKNOWN_MESSAGE,  "ui_update: Error. Message not recognized, header %d payload %d")
+BINLOG_ID(LOG_UNKNOWN_MONITOR,  "print_monitor: Error. Monitor command unrecognized: %d")
+BINLOG_ID(LOG_ELF_LOADER,       "ota_load: Error. ELF loader returned %d")
+BINLOG_ID(LOG_RUNICAST_TIMEOUT, "Runicast to %a timed out after %d retransmissions")
+BINLOG_ID(LOG_QUEUE_FULL,       "Event queue full, event %d lost, %d so far")
+BINLOG_ID(LOG_OUTBOX_FULL,      "Outbox full, message %d lost, %d so far")
@@ -0,0 +1,75 @@
+#include "binlog.h"
+
+#if (BINLOG_LEN & (BINLOG_LEN - 1)) != 0 || BINLOG_LEN > 128
+#error "BINLOG_LEN must be a power of two up to 128"
+#endif
+
+struct binlog_rec {
+    uint16_t time;
+    uint8_t id;
+    int16_t arg[2];
+};
+
+PROCESS(binlog_process, "Binary Log Flush");
+
+static struct binlog_rec ring[BINLOG_LEN];
+// Free running indexes, head - tail records are waiting
+static uint8_t head = 0;
+static uint8_t tail = 0;
+static uint16_t dropped = 0;
+
+void binlog_write (uint8_t id, int16_t a, int16_t b){
+    struct binlog_rec* rec;
+
+    if ((uint8_t) (head - tail) == BINLOG_LEN){
+        ++dropped;
+        return;
+    }
+    rec = &ring[head & (BINLOG_LEN - 1)];
+    rec->time = (uint16_t) clock_seconds();
+    rec->id = id;
+    rec->arg[0] = a;
+    rec->arg[1] = b;
+    ++head;
+    process_poll(&binlog_process);
+}
+
+static void binlog_flush (uint8_t max){
+    const struct binlog_rec* rec;
+
+    while (tail != head && max-- > 0){
+        rec = &ring[tail & (BINLOG_LEN - 1)];
+        printf("#L %u %u %d %d\n", rec->time, rec->id, rec->arg[0], rec->arg[1]);
+        ++tail;
+    }
+    // Room again, tell how much has been lost
+    if (dropped > 0 && tail == head){
+        binlog_write(LOG_DROPPED, (int16_t) dropped, 0);
+        dropped = 0;
+    }
+}
+
+void binlog_open (){
+    process_start(&binlog_process, NULL);
+}
+
+PROCESS_THREAD(binlog_process, ev, data){
+    static struct etimer idle_timer;
+    PROCESS_BEGIN();
+
+    while (true){
+        PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_POLL || ev == PROCESS_EVENT_TIMER);
+        // Other processes have work queued, look again later instead of
+        // spinning on polls ahead of them
+        if (process_nevents() > 0){
+            etimer_set(&idle_timer, CLOCK_SECOND / 16);
+            continue;
+        }
+        binlog_flush(BINLOG_BURST);
+        if (tail != head){
+            process_poll(&binlog_process);
+        }
+    }
+    PROCESS_END();
+    return 0;
+}
@@ -0,0 +1,35 @@
+/**
+Deferred binary log. BINLOG() stores a record number and two integers in a RAM
+ring and returns, binlog_process prints the pending records on the serial line
+when no other event is waiting, as "#L <seconds> <record> <arg> <arg>" lines
+that tools/binlog-decode.py turns back into text. The ring keeps the oldest
+records when it fills, the number of lost ones is logged once there is room
+**/
+#ifndef BINLOG_H_
+#define BINLOG_H_  1
+
+#include "nesproj.h"
+
+enum binlog_id {
+#define BINLOG_ID(id, format) id,
+#include "binlog-ids.h"
+#undef BINLOG_ID
+    LOG_ID_NUM
+};
+
+// Records in the ring, a power of two
+#ifndef BINLOG_LEN
+#define BINLOG_LEN  16
+#endif
+
+// Records printed for every idle poll, so that a burst doesn't hold the CPU
+#define BINLOG_BURST    4
+
+// Node address as a single argument, printed as "a.b" by the decoder
+#define BINLOG_ADDR(addr)   ((int16_t) (((addr)->u8[0] << 8) | (addr)->u8[1]))
+
+#define BINLOG(id, a, b)    binlog_write((id), (int16_t) (a), (int16_t) (b))
+
+void binlog_open (void);
+void binlog_write (uint8_t id, int16_t a, int16_t b);
+#endif
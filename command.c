@@ -0,0 +1,47 @@
+#include "command.h"
+
+enum cmd_verdict command_check (enum user_command cmd, const struct cu_view* view,
+                                enum message* out){
+    // Only the alarm can be changed while it is active
+    if (view->alarm == ENABLED && cmd != ALARM_ON_OFF){
+        return CMD_NOT_VALID;
+    }
+
+    switch (cmd){
+        case ALARM_ON_OFF:
+            *out = (view->alarm == ENABLED) ? ALARM_DISABLED : ALARM_ENABLED;
+            return CMD_ACCEPTED;
+
+        case GATE_UN_LOCK:
+            if (view->entrance != CLOSED){
+                return CMD_WAIT_CLOSE;
+            }
+            *out = (view->lock == UNLOCKED) ? GATE_LOCK : GATE_UNLOCK;
+            return CMD_ACCEPTED;
+
+        case ENTRANCE_OPEN_CLOSE:
+            if (view->lock == LOCKED){
+                return CMD_UNLOCK_GATE;
+            }
+            if (view->entrance != CLOSED){
+                return CMD_WAIT_CLOSE;
+            }
+            *out = ENTRANCE_OPEN;
+            return CMD_ACCEPTED;
+
+        case TEMP_AVG:
+            *out = GET_TEMP;
+            return CMD_ACCEPTED;
+
+        case EXT_LIGHT:
+            *out = GET_LIGHT;
+            return CMD_ACCEPTED;
+
+        case HVAC_ON_OFF:
+            *out = (view->hvac == ON) ? HVAC_OFF : HVAC_ON;
+            return CMD_ACCEPTED;
+
+        default:
+            return CMD_NOT_VALID;
+    }
+}
@@ -0,0 +1,28 @@
+/**
+Check of the commands issued by the user on the CU against the state of the
+nodes. It depends only on nesproj.h, so it builds on the host too (see bench/)
+**/
+#ifndef COMMAND_H_
+#define COMMAND_H_  1
+
+#include "nesproj.h"
+
+// What the CU knows of the nodes when a command is issued
+struct cu_view {
+    enum alarm_state alarm;
+    enum entrance_state entrance;
+    enum lock_state lock;
+    enum onoff_state hvac;
+};
+
+enum cmd_verdict {
+    CMD_ACCEPTED,
+    CMD_NOT_VALID,
+    CMD_WAIT_CLOSE,     // the entrance has to be closed first
+    CMD_UNLOCK_GATE     // the gate has to be unlocked first
+};
+
+// On CMD_ACCEPTED out is the message to send to the nodes
+enum cmd_verdict command_check (enum user_command cmd, const struct cu_view* view,
+                                enum message* out);
+#endif
@@ -0,0 +1,40 @@
+#include "cqueue.h"
+#include "fixmath.h"
+
+void cqueue_init (struct cqueue* q){
+    uint8_t i;
+    for (i = 0; i < CQUEUE_LEN; ++i){
+        q->samples[i] = INT_MIN;
+    }
+    q->idx = 0;
+    q->fill = 0;
+}
+
+void cqueue_insert (struct cqueue* q, int v){
+    q->samples[q->idx] = v;
+    if (++q->idx >= CQUEUE_LEN){
+        q->idx = 0;
+    }
+    if (q->fill < CQUEUE_LEN){
+        ++q->fill;
+    }
+}
+
+// How many samples are in the window, reported to the CU in the digest
+uint8_t cqueue_fill (const struct cqueue* q){
+    return q->fill;
+}
+
+// Average of the window, INT_MIN until it has been filled once
+int cqueue_avg (const struct cqueue* q){
+    int32_t sum = 0;
+    uint8_t i;
+
+    if (q->fill < CQUEUE_LEN){
+        return INT_MIN;
+    }
+    for (i = 0; i < CQUEUE_LEN; ++i){
+        sum += q->samples[i];
+    }
+    return fix_div(sum, CQUEUE_LEN);
+}
@@ -0,0 +1,24 @@
+/**
+Window of the last SMPL_NUM temperature samples averaged by the Door node.
+It depends only on nesproj.h and fixmath.h, so it builds on the host too
+(see bench/)
+**/
+#ifndef CQUEUE_H_
+#define CQUEUE_H_  1
+
+#include "nesproj.h"
+
+#define CQUEUE_LEN  SMPL_NUM
+
+// Circular array of samples, in hundredths of degree
+struct cqueue {
+    int samples[CQUEUE_LEN];
+    uint8_t idx;
+    uint8_t fill;
+};
+
+void cqueue_init (struct cqueue* q);
+void cqueue_insert (struct cqueue* q, int v);
+uint8_t cqueue_fill (const struct cqueue* q);
+int cqueue_avg (const struct cqueue* q);
+#endif
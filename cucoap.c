@@ -0,0 +1,243 @@
+#include "cucoap.h"
+#include "hvac.h"
+#include "rest-engine.h"
+#include "net/ip/uip.h"
+#include "net/ipv6/uip-ds6.h"
+#include "dev/slip.h"
+#include "dev/uart1.h"
+
+// State of the CU, kept by CentralUnit.c
+extern enum alarm_state alarm_state;
+extern enum entrance_state entrance_state;
+extern enum lock_state gate_lock_state;
+extern enum onoff_state hvac_state;
+extern int hvac_setpoint;
+extern int temperature;
+extern clock_time_t temperature_time;
+extern int light;
+extern clock_time_t light_time;
+
+PROCESS(cucoap_process, "Central Unit CoAP Front End");
+
+static uint8_t changed = 0;
+
+// Last state the observers have been notified, so that a redraw of the
+// monitor doesn't become a notification
+struct state_snapshot {
+    uint8_t alarm;
+    uint8_t entrance;
+    uint8_t lock;
+    uint8_t hvac;
+    int setpoint;
+};
+static struct state_snapshot notified;
+
+// Last reading the observers have been notified. A reading answered from the
+// cache of the CU, or a new one with the same value, isn't notified until
+// CUCOAP_MAX_AGE has passed, then it refreshes the observers
+struct reading_snapshot {
+    int value;
+    clock_time_t time;
+    unsigned long notified_at;
+};
+static struct reading_snapshot notified_temp;
+static struct reading_snapshot notified_light;
+
+static void take_snapshot (struct state_snapshot* s){
+    s->alarm = alarm_state;
+    s->entrance = entrance_state;
+    s->lock = gate_lock_state;
+    s->hvac = hvac_state;
+    s->setpoint = hvac_setpoint;
+}
+
+static bool reading_changed (struct reading_snapshot* s, int value, clock_time_t time){
+    unsigned long now = clock_seconds();
+
+    if (value == s->value && (time == s->time || now - s->notified_at < CUCOAP_MAX_AGE)){
+        return false;
+    }
+    s->value = value;
+    s->time = time;
+    s->notified_at = now;
+    return true;
+}
+
+static void json_reply (void* response, uint8_t* buffer, int len){
+    REST.set_header_content_type(response, REST.type.APPLICATION_JSON);
+    REST.set_response_payload(response, buffer, len);
+}
+
+static void state_get (void* request, void* response, uint8_t* buffer,
+                       uint16_t preferred_size, int32_t* offset){
+    json_reply(response, buffer,
+               snprintf((char*) buffer, preferred_size,
+                        "{\"alarm\":%u,\"entrance\":%u,\"lock\":%u,\"hvac\":%u,\"setpoint\":%d}",
+                        alarm_state, entrance_state, gate_lock_state, hvac_state,
+                        hvac_setpoint));
+}
+
+// Readings not received yet are null
+static int reading_json (uint8_t* buffer, uint16_t size, int value, clock_time_t time,
+                         bool valid){
+    if (!valid){
+        return snprintf((char*) buffer, size, "{\"value\":null}");
+    }
+    return snprintf((char*) buffer, size, "{\"value\":%d,\"time\":%u}", value,
+                    (unsigned int) time);
+}
+
+static void temp_get (void* request, void* response, uint8_t* buffer,
+                      uint16_t preferred_size, int32_t* offset){
+    json_reply(response, buffer, reading_json(buffer, preferred_size, temperature,
+                                              temperature_time,
+                                              temperature != INT_MAX && temperature != INT_MIN));
+}
+
+static void light_get (void* request, void* response, uint8_t* buffer,
+                       uint16_t preferred_size, int32_t* offset){
+    json_reply(response, buffer, reading_json(buffer, preferred_size, light, light_time,
+                                              light != INT_MIN));
+}
+
+// Payload: the number of the command as on the menu, 1 to 8
+static void cmd_post (void* request, void* response, uint8_t* buffer,
+                      uint16_t preferred_size, int32_t* offset){
+    const uint8_t* payload;
+    int len = REST.get_request_payload(request, &payload);
+    int cmd = (len == 1) ? payload[0] - '0' : 0;
+
+    if (cmd < ALARM_ON_OFF || cmd > COMMAND_NUMBER){
+        REST.set_response_status(response, REST.status.BAD_REQUEST);
+    }
+    else if (!cu_issue_command((enum user_command) cmd)){
+        REST.set_response_status(response, REST.status.SERVICE_UNAVAILABLE);
+    }
+    else {
+        REST.set_response_status(response, REST.status.CHANGED);
+    }
+}
+
+// Payload: setpoint in hundredths of degree
+static void setpoint_post (void* request, void* response, uint8_t* buffer,
+                           uint16_t preferred_size, int32_t* offset){
+    const uint8_t* payload;
+    char value[8];
+    int len = REST.get_request_payload(request, &payload);
+    int setpoint;
+
+    if (len <= 0 || len >= (int) sizeof(value)){
+        REST.set_response_status(response, REST.status.BAD_REQUEST);
+        return;
+    }
+    memcpy(value, payload, len);
+    value[len] = '\0';
+    setpoint = atoi(value);
+    if (setpoint < HVAC_SETPOINT_MIN || setpoint > HVAC_SETPOINT_MAX){
+        REST.set_response_status(response, REST.status.BAD_REQUEST);
+    }
+    else if (!cu_issue_setpoint(setpoint)){
+        REST.set_response_status(response, REST.status.SERVICE_UNAVAILABLE);
+    }
+    else {
+        REST.set_response_status(response, REST.status.CHANGED);
+    }
+}
+
+static void state_event (void);
+static void temp_event (void);
+static void light_event (void);
+
+EVENT_RESOURCE(res_state, "title=\"Alarm, entrance, gate lock and HVAC\";obs",
+               state_get, NULL, NULL, NULL, state_event);
+EVENT_RESOURCE(res_temp, "title=\"Average temperature, hundredths of degree\";obs",
+               temp_get, NULL, NULL, NULL, temp_event);
+EVENT_RESOURCE(res_light, "title=\"External light\";obs",
+               light_get, NULL, NULL, NULL, light_event);
+RESOURCE(res_cmd, "title=\"Command 1-8\"", NULL, cmd_post, NULL, NULL);
+RESOURCE(res_setpoint, "title=\"HVAC setpoint\"", NULL, setpoint_post, NULL, NULL);
+
+static void state_event (){
+    REST.notify_subscribers(&res_state);
+}
+
+static void temp_event (){
+    REST.notify_subscribers(&res_temp);
+}
+
+static void light_event (){
+    REST.notify_subscribers(&res_light);
+}
+
+// IPv6 goes to the serial line: with no route on the radio every packet is
+// handed to the fallback interface (UIP_FALLBACK_INTERFACE in project-conf.h)
+static void slip_init (){
+    slip_arch_init(BAUD2UBR(115200));
+    process_start(&slip_process, NULL);
+}
+
+static int slip_output (){
+    slip_send();
+    return 0;
+}
+
+struct uip_fallback_interface cucoap_slip = {slip_init, slip_output};
+
+void cucoap_open (){
+    uip_ipaddr_t addr;
+
+    // Same identifier a 16 bit short address gets in 6LoWPAN, fd00::ff:fe00:3
+    // for the CU. No prefix is added, so every reply goes to the fallback
+    uip_ip6addr(&addr, CUCOAP_PREFIX, 0, 0, 0, 0, 0x00ff, 0xfe00,
+                (linkaddr_node_addr.u8[0] << 8) | linkaddr_node_addr.u8[1]);
+    uip_ds6_addr_add(&addr, 0, ADDR_MANUAL);
+
+    rest_init_engine();
+    rest_activate_resource(&res_state, "state");
+    rest_activate_resource(&res_temp, "sensors/temp");
+    rest_activate_resource(&res_light, "sensors/light");
+    rest_activate_resource(&res_cmd, "cmd");
+    rest_activate_resource(&res_setpoint, "hvac/setpoint");
+    take_snapshot(&notified);
+    notified_temp.value = temperature;
+    notified_light.value = light;
+    process_start(&cucoap_process, NULL);
+}
+
+// Called by the monitor, the notifications are sent from this process and
+// not from the Rime callbacks the updates may come from
+void cucoap_changed (uint8_t resources){
+    if (resources != 0){
+        changed |= resources;
+        process_poll(&cucoap_process);
+    }
+}
+
+PROCESS_THREAD(cucoap_process, ev, data){
+    static struct state_snapshot now;
+    static uint8_t pending;
+    PROCESS_BEGIN();
+
+    while (true){
+        PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_POLL);
+        pending = changed;
+        changed = 0;
+
+        if (pending & CUCOAP_STATE){
+            take_snapshot(&now);
+            if (memcmp(&now, &notified, sizeof(now)) != 0){
+                notified = now;
+                res_state.trigger();
+            }
+        }
+        if ((pending & CUCOAP_TEMP) &&
+            reading_changed(&notified_temp, temperature, temperature_time)){
+            res_temp.trigger();
+        }
+        if ((pending & CUCOAP_LIGHT) && reading_changed(&notified_light, light, light_time)){
+            res_light.trigger();
+        }
+    }
+    PROCESS_END();
+    return 0;
+}
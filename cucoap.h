@@ -0,0 +1,31 @@
+/**
+CoAP front end of the CU, built with CU_COAP=1 (see README). The radio keeps
+speaking Rime with the actuators, IPv6 runs over SLIP on the serial line and a
+Linux host reaches the CU through tunslip6. The CU state and the last sensor
+readings are observable resources, commands are POSTed
+**/
+#ifndef CUCOAP_H_
+#define CUCOAP_H_  1
+
+#include "nesproj.h"
+
+// Prefix of the CU address, the interface identifier comes from its Rime
+// address
+#define CUCOAP_PREFIX   0xfd00
+
+// Resources to notify the observers of
+#define CUCOAP_STATE    0x01
+#define CUCOAP_TEMP     0x02
+#define CUCOAP_LIGHT    0x04
+
+// Seconds after which a reading with the same value is notified again
+#define CUCOAP_MAX_AGE  60
+
+void cucoap_open (void);
+void cucoap_changed (uint8_t resources);
+
+// Provided by CentralUnit.c, they return false if the CU can't take the
+// command now
+bool cu_issue_command (enum user_command cmd);
+bool cu_issue_setpoint (int setpoint);
+#endif
@@ -0,0 +1,42 @@
+#include "fixmath.h"
+
+// floor(65535 / n), the quotient estimated with it is never greater than the
+// exact one and it is corrected with the remainder
+static const uint16_t fix_recip[FIX_RECIP_MAX + 1] = {
+    0, 65535, 32767, 21845, 16383, 13107, 10922, 9362, 8191,
+    7281, 6553, 5957, 5461, 5041, 4681, 4369, 4095
+};
+
+// x / n truncated towards zero as the C division. The reciprocal product
+// fits 32 bits when |x| < 65535 * n, that is the case of a sum of n 16 bit
+// samples, larger values go to the software division as well
+int fix_div (int32_t x, uint8_t n){
+    uint32_t ux;
+    uint32_t q;
+    uint32_t r;
+
+    if (n == 0 || n > FIX_RECIP_MAX){
+        return n == 0 ? INT_MIN : (int) (x / n);
+    }
+    ux = (x < 0) ? (uint32_t) -x : (uint32_t) x;
+    if (ux >= 65535UL * n){
+        return (int) (x / n);
+    }
+    q = (ux * fix_recip[n]) >> 16;
+    r = ux - q * n;
+    while (r >= n){
+        ++q;
+        r -= n;
+    }
+    return (x < 0) ? -(int) q : (int) q;
+}
+
+int fix_sht11_centi (uint16_t raw){
+    return (int) raw - FIX_SHT11_OFFSET;
+}
+
+// Light value as 10 * raw / 7, that is raw + 3 * raw / 7 which stays in the
+// range of fix_div() for every raw value
+int fix_light_lux (uint16_t raw){
+    return (int) raw + fix_div(((int32_t) raw << 1) + raw, 7);
+}
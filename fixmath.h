@@ -0,0 +1,22 @@
+/**
+Division free fixed point arithmetic for the sensor conversions. The MSP430
+has no divide instruction, so divisions by small constants are done with a
+multiplication by the reciprocal taken from a table
+**/
+#ifndef FIXMATH_H_
+#define FIXMATH_H_  1
+
+#include "nesproj.h"
+
+// Largest divisor having its reciprocal in the table, larger ones fall back
+// to the software division
+#define FIX_RECIP_MAX   16
+
+// Temperature in hundredths of Celsius degree from the SHT11 raw value (14 bit
+// resolution, 3V supply): T = -39.60 + 0.01 * raw
+#define FIX_SHT11_OFFSET    3960
+
+int fix_div (int32_t x, uint8_t n);
+int fix_sht11_centi (uint16_t raw);
+int fix_light_lux (uint16_t raw);
+#endif
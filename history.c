@@ -0,0 +1,159 @@
+#include "history.h"
+
+// Longest record: a 32 bit time delta and a 17 bit value delta
+#define RECORD_MAX  (5 + 3)
+
+static struct history series[HISTORY_SERIES];
+
+struct history* history_find (const linkaddr_t* node, uint8_t sensor){
+    uint8_t i;
+    for (i = 0; i < HISTORY_SERIES; ++i){
+        if (series[i].used && series[i].sensor == sensor &&
+            linkaddr_cmp(&series[i].node, node)){
+            return &series[i];
+        }
+    }
+    return NULL;
+}
+
+struct history* history_get (uint8_t i){
+    return (i < HISTORY_SERIES && series[i].used) ? &series[i] : NULL;
+}
+
+struct history* history_series (const linkaddr_t* node, uint8_t sensor){
+    struct history* h = history_find(node, sensor);
+    uint8_t i;
+
+    for (i = 0; h == NULL && i < HISTORY_SERIES; ++i){
+        if (!series[i].used){
+            h = &series[i];
+            memset(h, 0, sizeof(*h));
+            linkaddr_copy(&h->node, node);
+            h->sensor = sensor;
+            h->used = true;
+        }
+    }
+    return h;
+}
+
+static uint8_t put_varint (uint8_t* out, uint32_t v){
+    uint8_t n = 0;
+    while (v >= 0x80){
+        out[n++] = (uint8_t) (v | 0x80);
+        v >>= 7;
+    }
+    out[n++] = (uint8_t) v;
+    return n;
+}
+
+// Decodes a varint from the ring starting at *pos, which is moved past it
+static uint32_t get_varint (const struct history* h, uint16_t* pos){
+    uint32_t v = 0;
+    uint8_t shift = 0;
+    uint8_t b;
+
+    do {
+        b = h->buf[*pos];
+        *pos = (*pos + 1 == HISTORY_BYTES) ? 0 : *pos + 1;
+        v |= (uint32_t) (b & 0x7F) << shift;
+        shift += 7;
+    } while (b & 0x80);
+    return v;
+}
+
+static uint32_t zigzag (int32_t v){
+    return ((uint32_t) v << 1) ^ (uint32_t) (v >> 31);
+}
+
+static int32_t unzigzag (uint32_t v){
+    return (int32_t) (v >> 1) ^ -(int32_t) (v & 1);
+}
+
+// Reads the record at *pos, adding its deltas to time and value
+static void next_record (const struct history* h, uint16_t* pos, uint32_t* time,
+                         int32_t* value){
+    *time += get_varint(h, pos);
+    *value += unzigzag(get_varint(h, pos));
+}
+
+// The second oldest reading becomes the first one
+static void drop_oldest (struct history* h){
+    uint16_t pos = h->head;
+    uint32_t time = h->first_time;
+    int32_t value = h->first_value;
+
+    next_record(h, &pos, &time, &value);
+    h->len -= (pos + HISTORY_BYTES - h->head) % HISTORY_BYTES;
+    h->head = pos;
+    h->first_time = time;
+    h->first_value = (int) value;
+    --h->count;
+}
+
+void history_append (struct history* h, uint32_t time, int value){
+    uint8_t record[RECORD_MAX];
+    uint8_t n;
+    uint8_t i;
+    uint16_t tail;
+
+    if (h->count == 0){
+        h->first_time = h->last_time = time;
+        h->first_value = h->last_value = value;
+        h->head = h->len = 0;
+        h->count = 1;
+        return;
+    }
+
+    // Readings are appended in arrival order, a clock going back is clamped
+    n = put_varint(record, (time > h->last_time) ? time - h->last_time : 0);
+    n += put_varint(record + n, zigzag((int32_t) value - h->last_value));
+    while (h->len + n > HISTORY_BYTES){
+        drop_oldest(h);
+    }
+    tail = (h->head + h->len) % HISTORY_BYTES;
+    for (i = 0; i < n; ++i){
+        h->buf[tail] = record[i];
+        tail = (tail + 1 == HISTORY_BYTES) ? 0 : tail + 1;
+    }
+    h->len += n;
+    if (time > h->last_time){
+        h->last_time = time;
+    }
+    h->last_value = value;
+    ++h->count;
+}
+
+bool history_query (const struct history* h, uint32_t from, uint32_t to,
+                    struct history_stats* stats){
+    uint16_t pos = h->head;
+    uint32_t time = h->first_time;
+    int32_t value = h->first_value;
+    int32_t sum = 0;
+    uint16_t i;
+
+    stats->count = 0;
+    for (i = 0; i < h->count; ++i){
+        if (i > 0){
+            next_record(h, &pos, &time, &value);
+        }
+        if (time > to){
+            break;
+        }
+        if (time < from){
+            continue;
+        }
+        if (stats->count == 0 || value < stats->min){
+            stats->min = (int) value;
+        }
+        if (stats->count == 0 || value > stats->max){
+            stats->max = (int) value;
+        }
+        sum += value;
+        ++stats->count;
+    }
+    if (stats->count == 0){
+        return false;
+    }
+    stats->avg = (int) (sum / stats->count);
+    return true;
+}
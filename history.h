@@ -0,0 +1,53 @@
+/**
+History of the readings received by the CU, one series for every node and
+sensor. A series keeps the first reading in full and every following one as
+the time and value deltas from the previous, varint encoded (the value delta
+zig-zag mapped first), in a ring of HISTORY_BYTES: appending drops the oldest
+readings when the ring is full. With a reading a minute a series holds a few
+hours. It depends only on nesproj.h (see bench/)
+**/
+#ifndef HISTORY_H_
+#define HISTORY_H_  1
+
+#include "nesproj.h"
+
+#define HISTORY_SERIES  4
+#ifndef HISTORY_BYTES
+#define HISTORY_BYTES   512
+#endif
+
+struct history {
+    linkaddr_t node;
+    uint8_t sensor;     // header of the messages carrying the readings
+    bool used;
+    uint16_t count;
+    // Oldest and newest readings, seconds and value
+    uint32_t first_time;
+    uint32_t last_time;
+    int first_value;
+    int last_value;
+    // Deltas of the readings after the first one
+    uint16_t head;
+    uint16_t len;
+    uint8_t buf[HISTORY_BYTES];
+};
+
+struct history_stats {
+    uint16_t count;
+    int min;
+    int max;
+    int avg;
+};
+
+// Series of a node and sensor, a new one is taken if there is room left
+struct history* history_series (const linkaddr_t* node, uint8_t sensor);
+struct history* history_find (const linkaddr_t* node, uint8_t sensor);
+// i-th series in use or NULL, to go through all of them
+struct history* history_get (uint8_t i);
+void history_append (struct history* h, uint32_t time, int value);
+
+// Statistics of the readings taken between from and to, both included. It
+// returns false if there isn't any
+bool history_query (const struct history* h, uint32_t from, uint32_t to,
+                    struct history_stats* stats);
+#endif
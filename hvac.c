@@ -0,0 +1,80 @@
+#include "hvac.h"
+
+// Largest error used, so that the products fit in 32 bits
+#define ERR_MAX     5000
+#define INTEGRAL_MAX    (((int32_t) HVAC_OUT_MAX << HVAC_FRAC) / HVAC_KI)
+
+void hvac_init (struct hvac* c){
+    c->on = false;
+    c->setpoint = HVAC_SETPOINT_DEFAULT;
+    c->integral = 0;
+    c->output = 0;
+}
+
+void hvac_set_on (struct hvac* c, bool on){
+    if (on != c->on){
+        c->integral = 0;
+        c->output = 0;
+    }
+    c->on = on;
+}
+
+bool hvac_set_point (struct hvac* c, int setpoint){
+    if (setpoint < HVAC_SETPOINT_MIN || setpoint > HVAC_SETPOINT_MAX){
+        return false;
+    }
+    c->setpoint = setpoint;
+    return true;
+}
+
+int8_t hvac_step (struct hvac* c, int centi){
+    int32_t err;
+    int32_t u;
+
+    if (!c->on){
+        return 0;
+    }
+
+    err = (int32_t) c->setpoint - centi;
+    if (err > ERR_MAX){
+        err = ERR_MAX;
+    }
+    else if (err < -ERR_MAX){
+        err = -ERR_MAX;
+    }
+
+    // Anti windup: the error is integrated only while the output isn't
+    // saturated in its direction
+    if (!(c->output >= HVAC_OUT_MAX && err > 0) && !(c->output <= -HVAC_OUT_MAX && err < 0)){
+        c->integral += err;
+        if (c->integral > INTEGRAL_MAX){
+            c->integral = INTEGRAL_MAX;
+        }
+        else if (c->integral < -INTEGRAL_MAX){
+            c->integral = -INTEGRAL_MAX;
+        }
+    }
+
+    u = (HVAC_KP * err + HVAC_KI * c->integral) >> HVAC_FRAC;
+    if (u > HVAC_OUT_MAX){
+        u = HVAC_OUT_MAX;
+    }
+    else if (u < -HVAC_OUT_MAX){
+        u = -HVAC_OUT_MAX;
+    }
+    c->output = (int8_t) u;
+    return c->output;
+}
+
+void hvac_model_init (struct hvac_model* m, int temp, int outside){
+    m->temp = (int32_t) temp << HVAC_MODEL_FRAC;
+    m->outside = outside;
+}
+
+int hvac_model_step (struct hvac_model* m, int8_t output){
+    int32_t outside = (int32_t) m->outside << HVAC_MODEL_FRAC;
+
+    m->temp += (outside - m->temp) >> HVAC_MODEL_LOSS;
+    m->temp += (int32_t) output * HVAC_MODEL_GAIN;
+    return (int) (m->temp >> HVAC_MODEL_FRAC);
+}
@@ -0,0 +1,54 @@
+/**
+HVAC control run by the Door on its own temperature samples: a fixed point PI
+controller whose output is the HVAC power, positive heating and negative
+cooling. The CU only changes the setpoint and turns it on or off, so the loop
+goes on regulating without it. A first order thermal model stands for the
+room in simulations (HVAC_SIM=1) and on the host (see bench/). It depends only
+on nesproj.h
+**/
+#ifndef HVAC_H_
+#define HVAC_H_  1
+
+#include "nesproj.h"
+
+// The controller runs on every sample of the anomaly detector
+#define HVAC_PERIOD_SECONDS     2
+
+// Gains in Q12, percent of power for an error in hundredths of degree: full
+// power for a 2 degree error, integral time of about 5 minutes
+#define HVAC_FRAC   12
+#define HVAC_KP     2048
+#define HVAC_KI     14
+#define HVAC_OUT_MAX    100
+
+#define HVAC_SETPOINT_DEFAULT   2100
+#define HVAC_SETPOINT_MIN       1000
+#define HVAC_SETPOINT_MAX       3000
+
+struct hvac {
+    bool on;
+    int setpoint;       // hundredths of degree
+    int32_t integral;   // sum of the errors
+    int8_t output;      // -HVAC_OUT_MAX..HVAC_OUT_MAX percent
+};
+
+void hvac_init (struct hvac* c);
+void hvac_set_on (struct hvac* c, bool on);
+// Returns false if the setpoint is out of range and it has not been changed
+bool hvac_set_point (struct hvac* c, int setpoint);
+int8_t hvac_step (struct hvac* c, int centi);
+
+// Room losing heat towards the outside with a time constant of about half an
+// hour, the HVAC at full power moves it by 1 degree a minute
+#define HVAC_MODEL_FRAC     8
+#define HVAC_MODEL_LOSS     10      // 1/2^10 of the difference every period
+#define HVAC_MODEL_GAIN     9       // Q8 hundredths of degree per percent
+
+struct hvac_model {
+    int32_t temp;       // Q8 hundredths of degree
+    int outside;
+};
+
+void hvac_model_init (struct hvac_model* m, int temp, int outside);
+int hvac_model_step (struct hvac_model* m, int8_t output);
+#endif
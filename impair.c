@@ -0,0 +1,94 @@
+#include "impair.h"
+
+// xorshift32, the same sequence on the motes and on the host
+static uint32_t impair_rand (struct impair* im){
+    uint32_t x = im->rng;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    im->rng = x;
+    return x;
+}
+
+static bool impair_chance (struct impair* im, uint16_t per_mille){
+    return per_mille > 0 && impair_rand(im) % 1000 < per_mille;
+}
+
+static uint16_t impair_delay (struct impair* im){
+    uint16_t delay = im->conf.latency;
+
+    if (im->conf.jitter > 0){
+        delay += impair_rand(im) % (im->conf.jitter + 1);
+    }
+    if (impair_chance(im, im->conf.reorder)){
+        delay += im->conf.reorder_ms;
+        ++im->stats.reordered;
+    }
+    if (delay > 0){
+        ++im->stats.delayed;
+    }
+    return delay;
+}
+
+static bool impair_lost (struct impair* im){
+    switch (im->conf.model){
+        case IMPAIR_BERNOULLI:
+            return impair_chance(im, im->conf.loss);
+
+        case IMPAIR_GILBERT:
+            // The state moves first, so a burst starts with the frame
+            // entering it
+            if (impair_chance(im, im->bad ? im->conf.to_good : im->conf.to_bad)){
+                im->bad = !im->bad;
+            }
+            return impair_chance(im, im->bad ? im->conf.loss : im->conf.loss_good);
+
+        default:
+            return false;
+    }
+}
+
+void impair_default_conf (struct impair_conf* conf){
+    conf->model = IMPAIR_MODEL;
+    conf->loss = IMPAIR_LOSS;
+    conf->loss_good = IMPAIR_LOSS_GOOD;
+    conf->to_bad = IMPAIR_TO_BAD;
+    conf->to_good = IMPAIR_TO_GOOD;
+    conf->latency = IMPAIR_LATENCY;
+    conf->jitter = IMPAIR_JITTER;
+    conf->dup = IMPAIR_DUP;
+    conf->reorder = IMPAIR_REORDER;
+    conf->reorder_ms = IMPAIR_REORDER_MS;
+    conf->seed = IMPAIR_SEED;
+}
+
+void impair_init (struct impair* im, const struct impair_conf* conf, uint16_t node){
+    memset(im, 0, sizeof(*im));
+    im->conf = *conf;
+    // Every node gets its own sequence, xorshift never leaves 0
+    im->rng = (conf->seed ^ ((uint32_t) node << 16) ^ node) | 1;
+}
+
+uint8_t impair_frame (struct impair* im, uint16_t delay[IMPAIR_COPIES]){
+    uint8_t copies = 1;
+
+    ++im->stats.frames;
+    if (impair_lost(im)){
+        ++im->stats.dropped;
+        return 0;
+    }
+    delay[0] = impair_delay(im);
+    if (impair_chance(im, im->conf.dup)){
+        delay[1] = impair_delay(im);
+        ++im->stats.duplicated;
+        ++copies;
+    }
+    return copies;
+}
+
+void impair_print (const struct impair* im){
+    printf("Impair: %u frames, %u dropped, %u duplicated, %u delayed, %u reordered, %u sent\n",
+           im->stats.frames, im->stats.dropped, im->stats.duplicated, im->stats.delayed,
+           im->stats.reordered, im->stats.sent);
+}
@@ -0,0 +1,110 @@
+/**
+Link impairment for the simulations. With LINK_IMPAIR set, every frame a node
+receives goes through impair_frame() before the MAC layer sees it: it can be
+lost (Bernoulli or Gilbert-Elliott), delayed by a latency and a jitter,
+duplicated or held back to arrive after the frames that follow it. The
+decisions come from a PRNG seeded with IMPAIR_SEED and the node address, so
+a run can be repeated. This part depends only on nesproj.h (see bench/), the
+MAC layer wrapper is in impairmac.c
+**/
+#ifndef IMPAIR_H_
+#define IMPAIR_H_  1
+
+#include "nesproj.h"
+
+#ifndef LINK_IMPAIR
+#define LINK_IMPAIR 0
+#endif
+
+// Probabilities are in per mille, times in ms. The defaults impair nothing,
+// a simulation sets them with DEFINES (tools/gen-topology.py --loss ...)
+#ifndef IMPAIR_MODEL
+#define IMPAIR_MODEL    IMPAIR_BERNOULLI
+#endif
+#ifndef IMPAIR_LOSS
+#define IMPAIR_LOSS     0
+#endif
+// Gilbert-Elliott: IMPAIR_LOSS is the loss in the bad state, the chain moves
+// to the bad state with IMPAIR_TO_BAD and back with IMPAIR_TO_GOOD per frame
+#ifndef IMPAIR_LOSS_GOOD
+#define IMPAIR_LOSS_GOOD    0
+#endif
+#ifndef IMPAIR_TO_BAD
+#define IMPAIR_TO_BAD   20
+#endif
+#ifndef IMPAIR_TO_GOOD
+#define IMPAIR_TO_GOOD  250
+#endif
+#ifndef IMPAIR_LATENCY
+#define IMPAIR_LATENCY  0
+#endif
+#ifndef IMPAIR_JITTER
+#define IMPAIR_JITTER   0
+#endif
+#ifndef IMPAIR_DUP
+#define IMPAIR_DUP      0
+#endif
+// Reordered frames are held back IMPAIR_REORDER_MS on top of their delay
+#ifndef IMPAIR_REORDER
+#define IMPAIR_REORDER  0
+#endif
+#ifndef IMPAIR_REORDER_MS
+#define IMPAIR_REORDER_MS   100
+#endif
+#ifndef IMPAIR_SEED
+#define IMPAIR_SEED     1
+#endif
+
+enum impair_model {
+    IMPAIR_NONE,
+    IMPAIR_BERNOULLI,
+    IMPAIR_GILBERT
+};
+
+struct impair_conf {
+    uint8_t model;
+    uint16_t loss;
+    uint16_t loss_good;
+    uint16_t to_bad;
+    uint16_t to_good;
+    uint16_t latency;
+    uint16_t jitter;
+    uint16_t dup;
+    uint16_t reorder;
+    uint16_t reorder_ms;
+    uint32_t seed;
+};
+
+struct impair_stats {
+    uint16_t frames;
+    uint16_t dropped;
+    uint16_t duplicated;
+    uint16_t delayed;
+    uint16_t reordered;
+    uint16_t sent;      // frames put on the air by the node, see impairmac.c
+};
+
+struct impair {
+    struct impair_conf conf;
+    uint32_t rng;
+    bool bad;
+    struct impair_stats stats;
+};
+
+// At most a frame and its duplicate are delivered
+#define IMPAIR_COPIES   2
+
+// The configuration given by the IMPAIR_ macros
+void impair_default_conf (struct impair_conf* conf);
+void impair_init (struct impair* im, const struct impair_conf* conf, uint16_t node);
+// Returns the copies of the frame to deliver, 0 if it is lost, and the delay
+// in ms of each of them
+uint8_t impair_frame (struct impair* im, uint16_t delay[IMPAIR_COPIES]);
+void impair_print (const struct impair* im);
+
+#if LINK_IMPAIR
+// Statistics of the wrapper of the node, impairmac.c
+const struct impair_stats* impair_mac_stats (void);
+void impair_mac_print (void);
+#endif
+#endif
@@ -0,0 +1,137 @@
+/**
+MAC layer wrapper applying impair.h to the received frames. It sits between
+nullrdc and csma (project-conf.h), after the duplicate detection of nullrdc so
+the duplicates it makes reach the network layer like the ones of a real link.
+Delayed frames are copied with their attributes and delivered by a ctimer,
+when all the slots are taken a frame is delivered at once
+**/
+#include "impair.h"
+
+#if LINK_IMPAIR
+#include "net/mac/mac.h"
+#include "net/mac/csma.h"
+#include "net/packetbuf.h"
+#include "sys/ctimer.h"
+
+// The commands, replies and acks of the nodes are well below the length,
+// OTA chunks and scenes fit too
+#define IMPAIR_QUEUE_LEN    3
+#define IMPAIR_FRAME_LEN    64
+
+struct held_frame {
+    struct ctimer timer;
+    struct packetbuf_attr attrs[PACKETBUF_NUM_ATTRS];
+    struct packetbuf_addr addrs[PACKETBUF_NUM_ADDRS];
+    uint8_t data[IMPAIR_FRAME_LEN];
+    uint8_t len;
+    bool used;
+};
+
+static struct impair link_impair;
+static struct held_frame held[IMPAIR_QUEUE_LEN];
+// The frame being received, csma consumes the packetbuf so every copy is
+// restored from here
+static struct held_frame current;
+
+static void frame_save (struct held_frame* f){
+    f->len = packetbuf_datalen();
+    memcpy(f->data, packetbuf_dataptr(), f->len);
+    packetbuf_attr_copyto(f->attrs, f->addrs);
+}
+
+static void frame_deliver (struct held_frame* f){
+    packetbuf_clear();
+    packetbuf_copyfrom(f->data, f->len);
+    packetbuf_attr_copyfrom(f->attrs, f->addrs);
+    csma_driver.input();
+}
+
+static void held_expired (void* ptr){
+    struct held_frame* f = (struct held_frame*) ptr;
+
+    f->used = false;
+    frame_deliver(f);
+}
+
+static bool frame_hold (uint16_t delay_ms){
+    clock_time_t delay = ((uint32_t) delay_ms * CLOCK_SECOND + 999) / 1000;
+    uint8_t i;
+
+    for (i = 0; i < IMPAIR_QUEUE_LEN; ++i){
+        if (!held[i].used){
+            memcpy(held[i].attrs, current.attrs, sizeof(current.attrs));
+            memcpy(held[i].addrs, current.addrs, sizeof(current.addrs));
+            memcpy(held[i].data, current.data, current.len);
+            held[i].len = current.len;
+            held[i].used = true;
+            ctimer_set(&held[i].timer, delay, held_expired, &held[i]);
+            return true;
+        }
+    }
+    return false;
+}
+
+static void init (void){
+    struct impair_conf conf;
+
+    impair_default_conf(&conf);
+    impair_init(&link_impair, &conf, linkaddr_node_addr.u8[0] | (linkaddr_node_addr.u8[1] << 8));
+    csma_driver.init();
+}
+
+static void send (mac_callback_t sent, void* ptr){
+    ++link_impair.stats.sent;
+    csma_driver.send(sent, ptr);
+}
+
+static void input (void){
+    uint16_t delay[IMPAIR_COPIES];
+    uint8_t copies;
+    uint8_t i;
+
+    if (packetbuf_datalen() > IMPAIR_FRAME_LEN){
+        csma_driver.input();
+        return;
+    }
+    copies = impair_frame(&link_impair, delay);
+    if (copies == 0){
+        return;
+    }
+    frame_save(&current);
+    for (i = 0; i < copies; ++i){
+        if (delay[i] == 0 || !frame_hold(delay[i])){
+            frame_deliver(&current);
+        }
+    }
+}
+
+static int on (void){
+    return csma_driver.on();
+}
+
+static int off (int keep_radio_on){
+    return csma_driver.off(keep_radio_on);
+}
+
+static unsigned short channel_check_interval (void){
+    return csma_driver.channel_check_interval();
+}
+
+const struct mac_driver impair_mac_driver = {
+    "impair",
+    init,
+    send,
+    input,
+    on,
+    off,
+    channel_check_interval,
+};
+
+const struct impair_stats* impair_mac_stats (){
+    return &link_impair.stats;
+}
+
+void impair_mac_print (){
+    impair_print(&link_impair);
+}
+#endif
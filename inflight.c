@@ -0,0 +1,83 @@
+#include "inflight.h"
+
+struct flight {
+    linkaddr_t node;
+    uint8_t sensor;     // header of the reply
+    uint8_t waiters;
+    bool busy;
+    unsigned long sent;
+};
+
+static struct flight flights[INFLIGHT_SLOTS];
+static struct inflight_stats stats;
+
+void inflight_init (){
+    memset(flights, 0, sizeof(flights));
+    memset(&stats, 0, sizeof(stats));
+}
+
+static struct flight* flight_find (const linkaddr_t* node, uint8_t sensor){
+    uint8_t i;
+
+    for (i = 0; i < INFLIGHT_SLOTS; ++i){
+        if (flights[i].busy && flights[i].sensor == sensor &&
+            linkaddr_cmp(&flights[i].node, node)){
+            return &flights[i];
+        }
+    }
+    return NULL;
+}
+
+bool inflight_request (const linkaddr_t* node, uint8_t sensor, unsigned long now){
+    struct flight* f = flight_find(node, sensor);
+    uint8_t i;
+
+    if (f != NULL){
+        if (f->waiters < 0xFF){
+            ++f->waiters;
+        }
+        // The request or its reply has been lost
+        if (now - f->sent >= INFLIGHT_WAIT){
+            f->sent = now;
+            ++stats.retried;
+            ++stats.sent;
+            return true;
+        }
+        ++stats.joined;
+        return false;
+    }
+    for (i = 0; i < INFLIGHT_SLOTS && flights[i].busy; ++i);
+    // No room to track it, it goes on the air like before
+    if (i < INFLIGHT_SLOTS){
+        f = &flights[i];
+        linkaddr_copy(&f->node, node);
+        f->sensor = sensor;
+        f->waiters = 1;
+        f->busy = true;
+        f->sent = now;
+    }
+    ++stats.sent;
+    return true;
+}
+
+uint8_t inflight_complete (const linkaddr_t* node, uint8_t sensor){
+    struct flight* f = flight_find(node, sensor);
+    uint8_t waiters;
+
+    ++stats.replies;
+    if (f == NULL){
+        return 0;
+    }
+    waiters = f->waiters;
+    f->busy = false;
+    return waiters;
+}
+
+const struct inflight_stats* inflight_get_stats (){
+    return &stats;
+}
+
+void inflight_print (){
+    printf("Sensor requests: %u sent, %u joined, %u retried, %u replies\n",
+           stats.sent, stats.joined, stats.retried, stats.replies);
+}
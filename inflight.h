@@ -0,0 +1,37 @@
+/**
+Single flight of the sensor requests of the CU. Only one request for a given
+node and sensor is on the air at a time: a request issued while another one
+is waiting for its reply joins it, and the reply completes all of them. A
+request not answered within INFLIGHT_WAIT seconds is sent again by the next
+one joining it. Times are passed in seconds, so it depends only on nesproj.h
+(see bench/)
+**/
+#ifndef INFLIGHT_H_
+#define INFLIGHT_H_  1
+
+#include "nesproj.h"
+
+// A reply usually comes back in well under a second, runicast included
+#ifndef INFLIGHT_WAIT
+#define INFLIGHT_WAIT   3
+#endif
+
+// Sensors the CU can read, temperature of the Door and light of the Gate
+// with room for two more
+#define INFLIGHT_SLOTS  4
+
+struct inflight_stats {
+    uint16_t sent;      // requests put on the air
+    uint16_t joined;    // requests that waited for one already on the air
+    uint16_t retried;   // requests sent again after INFLIGHT_WAIT
+    uint16_t replies;
+};
+
+void inflight_init (void);
+// Returns true if a request has to be sent, false if it has joined one
+bool inflight_request (const linkaddr_t* node, uint8_t sensor, unsigned long now);
+// Returns the requests completed by the reply, 0 if it wasn't waited for
+uint8_t inflight_complete (const linkaddr_t* node, uint8_t sensor);
+const struct inflight_stats* inflight_get_stats (void);
+void inflight_print (void);
+#endif
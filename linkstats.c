@@ -0,0 +1,147 @@
+#include "linkstats.h"
+#include "param.h"
+
+static struct link_stats links[LINK_STATS_LEN];
+static uint8_t link_victim = 0;
+
+// The CC2420 driver sets it for the packet and restores the radio power after
+static void set_txpower (uint8_t power){
+    packetbuf_set_attr(PACKETBUF_ATTR_RADIO_TXPOWER, power);
+}
+
+// Exponentially weighted moving average, the new sample weights 1/4
+static uint16_t ewma (uint16_t avg, uint16_t sample){
+    return (3 * avg + sample) >> 2;
+}
+
+static struct link_stats* link_get (const linkaddr_t* addr){
+    struct link_stats* link;
+    uint8_t i;
+
+    for (i = 0; i < LINK_STATS_LEN; ++i){
+        if (links[i].used && linkaddr_cmp(&links[i].addr, addr)){
+            return &links[i];
+        }
+    }
+
+    // A new neighbor starts at full power until its margin is known
+    link = &links[link_victim];
+    link_victim = (link_victim + 1) % LINK_STATS_LEN;
+    memset(link, 0, sizeof(*link));
+    linkaddr_copy(&link->addr, addr);
+    link->etx = LINK_ETX_UNIT;
+    link->rssi = LINK_RSSI_UNKNOWN;
+    link->txpower = LINK_TXPOWER_MAX;
+    link->txpower_min = LINK_TXPOWER_MIN;
+    link->used = true;
+    return link;
+}
+
+static void link_adapt_power (struct link_stats* link, bool delivered){
+    if (!delivered){
+        link->good = 0;
+        if (link->txpower == LINK_TXPOWER_MAX){
+            return;
+        }
+        if (link->txpower <= link->txpower_min){
+            // Lost at a level which worked before, the link got worse: full
+            // power, and the way down stops a step earlier
+            link->txpower = LINK_TXPOWER_MAX;
+            if (link->txpower_min + LINK_TXPOWER_STEP < LINK_TXPOWER_MAX){
+                link->txpower_min += LINK_TXPOWER_STEP;
+            }
+        }
+        else {
+            link->txpower += LINK_TXPOWER_STEP;
+            link->txpower_min = link->txpower;
+        }
+        return;
+    }
+    if (link->etx > LINK_ETX_GOOD || link->rssi == LINK_RSSI_UNKNOWN ||
+        link->rssi < LINK_RSSI_GOOD){
+        link->good = 0;
+        return;
+    }
+    if (++link->good >= LINK_GOOD_FRAMES){
+        link->good = 0;
+        if (link->txpower >= link->txpower_min + LINK_TXPOWER_STEP){
+            link->txpower -= LINK_TXPOWER_STEP;
+        }
+    }
+}
+
+void link_stats_rx (const linkaddr_t* from){
+    struct link_stats* link = link_get(from);
+
+    link->lqi = ewma(link->lqi, packetbuf_attr(PACKETBUF_ATTR_LINK_QUALITY));
+}
+
+void link_stats_beacon (const linkaddr_t* from){
+    struct link_stats* link = link_get(from);
+    int16_t rssi = (int8_t) packetbuf_attr(PACKETBUF_ATTR_RSSI) + LINK_RSSI_OFFSET;
+
+    if (link->rssi == LINK_RSSI_UNKNOWN){
+        link->rssi = rssi;
+    }
+    else {
+        link->rssi = (3 * link->rssi + rssi) >> 2;
+    }
+}
+
+void link_stats_tx (const linkaddr_t* to, uint8_t retransmissions, bool delivered){
+    struct link_stats* link = link_get(to);
+
+    ++link->sent;
+    if (delivered){
+        link->fails = 0;
+        link->etx = ewma(link->etx, (retransmissions + 1) << LINK_ETX_SHIFT);
+    }
+    else {
+        // A lost packet counts twice the transmissions it has taken
+        ++link->lost;
+        if (link->fails < UINT8_MAX){
+            ++link->fails;
+        }
+        link->etx = ewma(link->etx, (retransmissions + 1) << (LINK_ETX_SHIFT + 1));
+    }
+    link_adapt_power(link, delivered);
+}
+
+// Set the transmission power for the neighbor and return the runicast retry
+// budget, twice the expected transmissions
+uint8_t link_prepare (const linkaddr_t* to){
+    struct link_stats* link = link_get(to);
+    uint8_t retx;
+
+    set_txpower(link->txpower);
+    if (link->fails >= LINK_DEAD_FAILS){
+        return LINK_RETX_DEAD;
+    }
+    retx = (2 * link->etx + LINK_ETX_UNIT - 1) >> LINK_ETX_SHIFT;
+    return (retx > param_get(PARAM_MAX_RETX)) ? param_get(PARAM_MAX_RETX) : retx;
+}
+
+// Broadcasts have to reach every node, and they are the samples of the RSSI
+// margin of the others
+void link_prepare_broadcast (){
+    set_txpower(LINK_TXPOWER_MAX);
+}
+
+// Backoff of the application retries, longer on links needing more
+// transmissions
+clock_time_t link_backoff (const linkaddr_t* to, clock_time_t base){
+    return ((uint32_t) base * link_get(to)->etx) >> LINK_ETX_SHIFT;
+}
+
+void link_stats_print (){
+    uint8_t i;
+
+    for (i = 0; i < LINK_STATS_LEN; ++i){
+        if (links[i].used){
+            printf("Link %d.%d: rssi %d dBm, lqi %u, etx %u/%u, power %u (min %u), sent %u, lost %u\n",
+                   links[i].addr.u8[0], links[i].addr.u8[1], links[i].rssi,
+                   links[i].lqi, links[i].etx, LINK_ETX_UNIT, links[i].txpower,
+                   links[i].txpower_min, links[i].sent, links[i].lost);
+        }
+    }
+}
@@ -0,0 +1,65 @@
+/**
+Per neighbor link statistics, updated from the Rime callbacks, and the
+transmission parameters chosen from them: runicast retry budget, backoff of
+the application retries and CC2420 transmission power of the unicasts. The
+power is set on the packet (PACKETBUF_ATTR_RADIO_TXPOWER), the radio stays at
+full power for the broadcasts and the acknowledgments
+**/
+#ifndef LINKSTATS_H_
+#define LINKSTATS_H_  1
+
+#include "nesproj.h"
+
+#define LINK_STATS_LEN  4
+
+// ETX is kept in fixed point, 1 << LINK_ETX_SHIFT is one transmission
+#define LINK_ETX_SHIFT  3
+#define LINK_ETX_UNIT   (1 << LINK_ETX_SHIFT)
+
+// After LINK_DEAD_FAILS consecutive timeouts the link is considered dead and
+// a single retransmission is tried, to detect the failure early
+#define LINK_DEAD_FAILS 2
+#define LINK_RETX_DEAD  1
+
+// CC2420 RSSI register to dBm
+#define LINK_RSSI_OFFSET    -45
+
+// Transmission power is lowered by a step after LINK_GOOD_FRAMES delivered
+// in a row with the ETX and the RSSI margin better than these. A loss takes it
+// back to the last level that worked, which becomes the lowest one for the
+// neighbor; a link lost at that level too goes back to the maximum and stops
+// a step higher on the way down. The RSSI
+// is only sampled on frames the neighbor sends at full power (broadcasts and
+// sync beacons), so it measures the margin of the link and not the power the
+// neighbor has chosen; without a sample the power isn't lowered
+#define LINK_RSSI_GOOD      -70
+#define LINK_RSSI_UNKNOWN   INT16_MIN
+#define LINK_ETX_GOOD       (LINK_ETX_UNIT + (LINK_ETX_UNIT >> 2))
+#define LINK_GOOD_FRAMES    8
+#define LINK_TXPOWER_MAX    31
+#define LINK_TXPOWER_MIN    3
+#define LINK_TXPOWER_STEP   4
+
+struct link_stats {
+    linkaddr_t addr;
+    int16_t rssi;
+    uint8_t lqi;
+    uint16_t etx;
+    uint8_t fails;
+    uint8_t txpower;
+    uint8_t txpower_min;
+    uint8_t good;
+    uint16_t sent;
+    uint16_t lost;
+    bool used;
+};
+
+void link_stats_rx (const linkaddr_t* from);
+// A frame sent by the neighbor at full power has been received
+void link_stats_beacon (const linkaddr_t* from);
+void link_stats_tx (const linkaddr_t* to, uint8_t retransmissions, bool delivered);
+uint8_t link_prepare (const linkaddr_t* to);
+void link_prepare_broadcast (void);
+clock_time_t link_backoff (const linkaddr_t* to, clock_time_t base);
+void link_stats_print (void);
+#endif
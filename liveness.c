@@ -0,0 +1,128 @@
+#include "liveness.h"
+#include "sys/energest.h"
+
+static clock_time_t last_tx = 0;
+static uint16_t frames_sent = 0;
+static uint16_t keepalives_sent = 0;
+
+void heartbeat_sent (){
+    last_tx = clock_time();
+    ++frames_sent;
+}
+
+void heartbeat_keepalive (){
+    ++keepalives_sent;
+}
+
+clock_time_t heartbeat_idle (){
+    return clock_time() - last_tx;
+}
+
+// Cost of the heartbeats: keepalives against all the frames sent, and the
+// radio time spent transmitting
+void heartbeat_print (){
+#if ENERGEST_CONF_ON
+    energest_flush();
+    printf("Heartbeat: %u frames, %u keepalives, tx %lu ms\n", frames_sent, keepalives_sent,
+           (unsigned long) energest_type_time(ENERGEST_TYPE_TRANSMIT) * 1000 / RTIMER_SECOND);
+#else
+    printf("Heartbeat: %u frames, %u keepalives\n", frames_sent, keepalives_sent);
+#endif
+}
+
+struct liveness {
+    linkaddr_t addr;
+    unsigned long last_seen;
+    uint16_t frames;
+    bool used;
+    bool suspected;
+};
+
+static struct liveness nodes[LIVENESS_NODES];
+
+static struct liveness* liveness_find (const linkaddr_t* node, bool add){
+    uint8_t i;
+    struct liveness* free = NULL;
+
+    for (i = 0; i < LIVENESS_NODES; ++i){
+        if (nodes[i].used && linkaddr_cmp(&nodes[i].addr, node)){
+            return &nodes[i];
+        }
+        if (!nodes[i].used && free == NULL){
+            free = &nodes[i];
+        }
+    }
+    if (add && free != NULL){
+        memset(free, 0, sizeof(*free));
+        linkaddr_copy(&free->addr, node);
+        free->last_seen = clock_seconds();
+        free->used = true;
+    }
+    return add ? free : NULL;
+}
+
+// Nodes the CU expects to hear from even if they never send anything
+void liveness_watch (const linkaddr_t* node){
+    liveness_find(node, true);
+}
+
+// Only the watched nodes are tracked, the others (stress nodes, a remote)
+// can't push them out of the table
+bool liveness_seen (const linkaddr_t* node){
+    struct liveness* n = liveness_find(node, false);
+    bool back;
+
+    if (n == NULL){
+        return false;
+    }
+    back = n->suspected;
+    n->last_seen = clock_seconds();
+    n->suspected = false;
+    ++n->frames;
+    return back;
+}
+
+bool liveness_failed (const linkaddr_t* node){
+    struct liveness* n = liveness_find(node, false);
+
+    if (n == NULL || n->suspected){
+        return false;
+    }
+    n->suspected = true;
+    return true;
+}
+
+bool liveness_check (){
+    unsigned long now = clock_seconds();
+    bool changed = false;
+    uint8_t i;
+
+    for (i = 0; i < LIVENESS_NODES; ++i){
+        if (nodes[i].used && !nodes[i].suspected &&
+            now - nodes[i].last_seen > LIVENESS_TIMEOUT){
+            nodes[i].suspected = true;
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+// The suspected nodes, or all of them with their last seen time and frames
+void liveness_print (bool all){
+    unsigned long now = clock_seconds();
+    bool none = true;
+    uint8_t i;
+
+    for (i = 0; i < LIVENESS_NODES; ++i){
+        if (nodes[i].used && (all || nodes[i].suspected)){
+            printf("Node %d.%d %s, last heard %lu s ago, %u frames\n",
+                   nodes[i].addr.u8[0], nodes[i].addr.u8[1],
+                   nodes[i].suspected ? "NOT RESPONDING" : "alive",
+                   now - nodes[i].last_seen, nodes[i].frames);
+            none = false;
+        }
+    }
+    if (none){
+        printf("All nodes alive, detection time %u s\n", LIVENESS_TIMEOUT);
+    }
+}
@@ -0,0 +1,39 @@
+/**
+Liveness of the actuators. Every frame a node sends to the CU tells it the
+node is alive, so a node sends a keepalive (its state digest) only when it
+hasn't sent anything else for HEARTBEAT_SECONDS. The CU keeps the last time it
+heard from every node and suspects a node it hasn't heard from for
+LIVENESS_TIMEOUT seconds, or at once when a runicast to it times out
+**/
+#ifndef LIVENESS_H_
+#define LIVENESS_H_  1
+
+#include "nesproj.h"
+
+// Detection time of the CU, a few heartbeats so that a lost keepalive isn't
+// taken for a failure. Shorter heartbeats detect failures earlier at the cost
+// of more keepalives on idle links
+#ifndef LIVENESS_TIMEOUT
+#define LIVENESS_TIMEOUT    (HEARTBEAT_SECONDS * 3 + 5)
+#endif
+
+#define LIVENESS_NODES  8
+
+// Node side: msg2cu() calls heartbeat_sent() for every frame, a keepalive is
+// due once heartbeat_idle() reaches DIGEST_PERIOD. heartbeat_print() is the
+// report of "heartbeat" on the serial line of the node
+void heartbeat_sent (void);
+void heartbeat_keepalive (void);
+clock_time_t heartbeat_idle (void);
+void heartbeat_print (void);
+
+// CU side. liveness_seen() and liveness_failed() are called from the Rime
+// callbacks, liveness_check() every second; they return true when a node
+// has been suspected or has come back. Only the nodes given to
+// liveness_watch() are tracked
+void liveness_watch (const linkaddr_t* node);
+bool liveness_seen (const linkaddr_t* node);
+bool liveness_failed (const linkaddr_t* node);
+bool liveness_check (void);
+void liveness_print (bool all);
+#endif
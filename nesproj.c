@@ -8,6 +8,10 @@ uint16_t get_payload (msg_t* msg){
     return msg->payload;
 }
 
+uint8_t get_seq (msg_t* msg){
+    return msg->seq;
+}
+
 void set_header (msg_t* msg, uint8_t hdr_data){
     msg->hdr = hdr_data;
 }
@@ -16,13 +20,92 @@ void set_payload (msg_t* msg, uint16_t payload){
     msg->payload = payload;
 }
 
+void set_seq (msg_t* msg, uint8_t seq){
+    msg->seq = seq;
+}
+
+uint8_t get_group (msg_t* msg){
+    return msg->group;
+}
+
+void set_group (msg_t* msg, uint8_t group){
+    msg->group = group;
+}
+
+// Roles and zones are matched apart, so GROUP_DOOR | GROUP_ZONE(1) is for the
+// doors of zone 1 only. No role bits means any role, no zone bits any zone
+bool in_group (const msg_t* msg, uint8_t groups){
+    uint8_t roles = msg->group & GROUP_ROLES;
+    uint8_t zones = msg->group & GROUP_ZONES;
+
+    return (roles == 0 || (roles & groups) != 0) &&
+           (zones == 0 || (zones & groups) != 0);
+}
+
 struct msg_t set_message (uint8_t hdr, uint16_t payload){
     msg_t msg;
     msg.hdr = hdr;
+    msg.seq = 0;
     msg.payload = payload;
+    msg.time = 0;
+    msg.group = GROUP_ALL;
     return msg;
 }
 
 struct msg_t get_message_from (void* raw_data){
     return *((msg_t*) raw_data);
 }
+
+uint16_t pack_digest (enum alarm_state alarm, enum lock_state lock,
+                      enum entrance_state entrance, uint8_t fill, enum onoff_state hvac){
+    return (uint16_t) ((alarm & 0x03) |
+                       ((lock & 0x03) << 2) |
+                       ((entrance & 0x01) << 4) |
+                       ((fill & 0x0F) << 5) |
+                       ((hvac & 0x01) << 9));
+}
+
+struct dedup_entry {
+    linkaddr_t sender;
+    uint8_t seq;
+    bool used;
+};
+
+static struct dedup_entry dedup_cache[DEDUP_CACHE_LEN];
+static uint8_t dedup_victim = 0;
+
+bool is_duplicate (const linkaddr_t* from, uint8_t seq){
+    uint8_t i;
+
+    if (seq == 0){
+        return false;
+    }
+    for (i = 0; i < DEDUP_CACHE_LEN; ++i){
+        if (dedup_cache[i].used && linkaddr_cmp(&dedup_cache[i].sender, from)){
+            if (dedup_cache[i].seq == seq){
+                return true;
+            }
+            dedup_cache[i].seq = seq;
+            return false;
+        }
+    }
+
+    // Unknown sender, evict the entries in round robin
+    linkaddr_copy(&dedup_cache[dedup_victim].sender, from);
+    dedup_cache[dedup_victim].seq = seq;
+    dedup_cache[dedup_victim].used = true;
+    dedup_victim = (dedup_victim + 1) % DEDUP_CACHE_LEN;
+    return false;
+}
+
+void dedup_reset (){
+    memset(dedup_cache, 0, sizeof(dedup_cache));
+    dedup_victim = 0;
+}
+
+enum rx_result filter_from_cu (const linkaddr_t* from, const msg_t* msg, uint8_t groups){
+    if (from->u8[0] != CU_ADDR_0 || from->u8[1] != CU_ADDR_1 || !in_group(msg, groups)){
+        return RX_FOREIGN;
+    }
+    return is_duplicate(from, msg->seq) ? RX_DUPLICATE : RX_ACCEPTED;
+}
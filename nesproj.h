@@ -31,6 +31,13 @@ Header file containing the common declarations and things used by sensors
 #define RMT_ADDR_0 4
 #define RMT_ADDR_1 0
 
+// Synthetic topologies have many Door and Gate nodes, built with
+// KEEP_NODE_ADDR=1 they keep the address given by the simulator instead of
+// the fixed one. See tools/gen-topology.py
+#ifndef KEEP_NODE_ADDR
+#define KEEP_NODE_ADDR  0
+#endif
+
 // Message length, equal for all messages
 #define MSG_LEN     8
 
@@ -38,31 +45,87 @@ Header file containing the common declarations and things used by sensors
 #define RU_CH 144
 #define BC_CH 129
 
-// How long leds have to blink
-#define BLINK_PERIOD    CLOCK_SECOND*2
 #define SMPL_TEMP_PERIOD_SECONDS    10
 #define SMPL_TEMP_PERIOD    CLOCK_SECOND*SMPL_TEMP_PERIOD_SECONDS
+// How many temperature samples the Door node averages
+#define SMPL_NUM    5
+
+// Time the guest has to go through before the door starts opening
+#define GUEST_WAIT  (CLOCK_SECOND*14)
 
 // Application message and function to manage it
+// seq is set by the CU on every command and echoed back in the replies, a
+// retransmitted command keeps its seq so actuators can drop the duplicates.
+// seq 0 is reserved for unsolicited messages and it is never deduplicated.
+// time is in network time (see netsync.h): the execute-at time of a command
+// or the time a message from a node has been sent; PARAM_MSG requests carry
+// the operation and the parameter in it instead.
+// group is the mask of the node groups a command is for, GROUP_ALL for any
+// node. The actuators drop a command for other groups in the receive
+// callback, before it reaches their processes
 typedef struct msg_t {
     uint8_t hdr;
+    uint8_t seq;
     uint16_t payload;
+    uint16_t time;
+    uint8_t group;
 } msg_t;
 
+// Node groups: the role of the node and up to six zones, a node can be in
+// more than one (NODE_GROUPS in Door.c and Gate.c). A command is for the nodes
+// having one of its roles and one of its zones, the roles or the zones left
+// out match any node
+#define GROUP_ALL       0x00
+#define GROUP_DOOR      0x01
+#define GROUP_GATE      0x02
+#define GROUP_ZONE(n)   (0x04 << (n))
+#define GROUP_ROLES     (GROUP_DOOR | GROUP_GATE)
+#define GROUP_ZONES     ((uint8_t) ~GROUP_ROLES)
+
 enum msg_hdr_t{
     TEMP_MSG = 0x0F,
     LIGHT_MSG = 0x0A,
+    STATE_MSG = 0x05,
+    SYNC_MSG = 0x03,
+    OTA_MSG = 0x0B,
+    ALERT_MSG = 0x0C,   // unsolicited, temperature in hundredths of degree
+    HVAC_MSG = 0x0D,    // HVAC setpoint, hundredths of degree
+    SCENE_MSG = 0x0E,   // batch of actions and its report, see scene.h
+    PARAM_MSG = 0x10,   // runtime parameter get/set and reply, see param.h
     CMD_MSG = 0x00
 };
 
 uint8_t get_header (msg_t* msg);
 uint16_t get_payload (msg_t* msg);
+uint8_t get_seq (msg_t* msg);
 void set_header (msg_t* msg, uint8_t hdr_data);
 void set_payload (msg_t* msg, uint16_t payload);
+void set_seq (msg_t* msg, uint8_t seq);
+uint8_t get_group (msg_t* msg);
+void set_group (msg_t* msg, uint8_t group);
+bool in_group (const msg_t* msg, uint8_t groups);
 struct msg_t set_message (uint8_t hdr, uint16_t payload);
 struct msg_t get_message_from (void* raw_data);
 
-#define COMMAND_NUMBER 6
+// Per-sender cache of the last command sequence number seen, used by the
+// actuators to suppress retransmitted commands. They aren't run again but
+// answered with the reply kept by the outbox (outbox_resend()). The sequence
+// numbers of the CU start again at every boot, the cache is reset when the
+// sync beacons bring a new boot epoch of the CU (netsync.h)
+#define DEDUP_CACHE_LEN 2
+bool is_duplicate (const linkaddr_t* from, uint8_t seq);
+void dedup_reset (void);
+
+// Receive filter of the actuators, shared with bench/replay: messages from any
+// node except for the CU and commands for other groups are foreign
+enum rx_result {
+    RX_ACCEPTED,
+    RX_DUPLICATE,
+    RX_FOREIGN
+};
+enum rx_result filter_from_cu (const linkaddr_t* from, const msg_t* msg, uint8_t groups);
+
+#define COMMAND_NUMBER 8
 enum user_command {
                NO_CMD = 0,
                ALARM_ON_OFF = 1,
@@ -70,7 +133,9 @@ enum user_command {
                ENTRANCE_OPEN_CLOSE = 3,
                TEMP_AVG = 4,
                EXT_LIGHT = 5,
-               HVAC_ON_OFF = 6
+               HVAC_ON_OFF = 6,
+               SCENE_1 = 7,
+               SCENE_2 = 8
 };
 
 enum alarm_state {
@@ -105,5 +170,27 @@ enum message {
     ENTRANCE_CLOSE,
     GET_TEMP,
     GET_LIGHT,
+    HVAC_ON,
+    HVAC_OFF
 };
+
+// Compact state digest sent by the actuators inside a STATE_MSG payload:
+// bits 0-1 alarm state, bits 2-3 lock state, bit 4 entrance state, bits 5-8
+// how many samples fill the temperature window and bit 9 the HVAC state of
+// the Door (off for the Gate). It is sent DIGEST_DELAY
+// after any state change and as keepalive when a node hasn't sent anything
+// for DIGEST_PERIOD (see liveness.h)
+#ifndef HEARTBEAT_SECONDS
+#define HEARTBEAT_SECONDS   30
+#endif
+#define DIGEST_PERIOD   CLOCK_SECOND*HEARTBEAT_SECONDS
+#define DIGEST_DELAY    CLOCK_SECOND
+#define DIGEST_ALARM(d)     ((enum alarm_state) ((d) & 0x03))
+#define DIGEST_LOCK(d)      ((enum lock_state) (((d) >> 2) & 0x03))
+#define DIGEST_ENTRANCE(d)  ((enum entrance_state) (((d) >> 4) & 0x01))
+#define DIGEST_FILL(d)      ((uint8_t) (((d) >> 5) & 0x0F))
+#define DIGEST_HVAC(d)      ((enum onoff_state) (((d) >> 9) & 0x01))
+
+uint16_t pack_digest (enum alarm_state alarm, enum lock_state lock,
+                      enum entrance_state entrance, uint8_t fill, enum onoff_state hvac);
 #endif
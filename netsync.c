@@ -0,0 +1,108 @@
+#include "netsync.h"
+#include "linkstats.h"
+#include "trace.h"
+
+PROCESS(netsync_process, "Network Time Authority Process");
+
+static struct broadcast_conn sync_broadcast;
+static clock_time_t offset = 0;
+static bool synced = false;
+static bool is_authority = false;
+// Seconds and network time of the CU in the last beacon
+static uint16_t beacon_seconds;
+static clock_time_t beacon_time;
+// Boot epoch of the CU, sent in the seq of the beacons
+static uint8_t epoch;
+static bool epoch_known = false;
+
+static void sync_recv (struct broadcast_conn *c, const linkaddr_t *from){
+    msg_t msg = get_message_from(packetbuf_dataptr());
+
+    TRACE_RX(SYNC_CH, from);
+    link_stats_beacon(from);
+    // Only the CU is the time authority
+    if (from->u8[0] == CU_ADDR_0 && from->u8[1] == CU_ADDR_1 && msg.hdr == SYNC_MSG){
+        offset = msg.time - clock_time();
+        beacon_seconds = msg.payload;
+        beacon_time = msg.time;
+        synced = true;
+        if (epoch_known && msg.seq != epoch){
+            dedup_reset();
+        }
+        epoch = msg.seq;
+        epoch_known = true;
+    }
+}
+
+static const struct broadcast_callbacks sync_call = {sync_recv};
+
+void netsync_open (bool authority){
+    broadcast_open(&sync_broadcast, SYNC_CH, &sync_call);
+    if (authority){
+        is_authority = true;
+        synced = true;
+        process_start(&netsync_process, NULL);
+    }
+}
+
+void netsync_set_epoch (uint8_t e){
+    epoch = e;
+}
+
+bool netsync_is_synced (){
+    return synced;
+}
+
+clock_time_t netsync_time (){
+    return clock_time() + offset;
+}
+
+// The CU stamps with its own clock, the nodes count from its last beacon,
+// which is a few SYNC_PERIOD at most before now
+void netsync_stamp (uint16_t* seconds, uint8_t* ticks){
+    clock_time_t since;
+
+    if (!synced || is_authority){
+        *seconds = (uint16_t) clock_seconds();
+        *ticks = clock_time() % CLOCK_SECOND;
+        return;
+    }
+    since = beacon_time % CLOCK_SECOND + (netsync_time() - beacon_time);
+    *seconds = beacon_seconds + since / CLOCK_SECOND;
+    *ticks = since % CLOCK_SECOND;
+}
+
+// How long to wait from now to reach net_time, 0 if it is already expired or
+// the node isn't synchronized yet
+clock_time_t netsync_wait (clock_time_t net_time){
+    clock_time_t wait = net_time - netsync_time();
+
+    if (!synced || wait > SYNC_MAX_WAIT){
+        return 0;
+    }
+    return wait;
+}
+
+PROCESS_THREAD(netsync_process, ev, data){
+    static struct etimer beacon_timer;
+    static msg_t msg;
+
+    PROCESS_EXITHANDLER(broadcast_close(&sync_broadcast);)
+    PROCESS_BEGIN();
+
+    etimer_set(&beacon_timer, CLOCK_SECOND);
+    while (true){
+        PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&beacon_timer));
+        msg = set_message(SYNC_MSG, (uint16_t) clock_seconds());
+        msg.seq = epoch;
+        msg.time = netsync_time();
+        packetbuf_copyfrom(&msg, sizeof(msg));
+        TRACE_TX(SYNC_CH, &linkaddr_null);
+        link_prepare_broadcast();
+        broadcast_send(&sync_broadcast);
+        etimer_set(&beacon_timer, SYNC_PERIOD);
+    }
+
+    PROCESS_END();
+    return 0;
+}
@@ -0,0 +1,35 @@
+/**
+Lightweight network time. The CU is the time authority and periodically
+broadcasts its clock, the other nodes keep the offset between it and their
+own clock. Network time is expressed in clock ticks and wraps as clock_time().
+The beacons carry the seconds of the CU as well, for the stamps that must not
+wrap as often (netsync_stamp()), and its boot epoch: a node seeing it change
+forgets the command sequence numbers of the CU before the reboot
+**/
+#ifndef NETSYNC_H_
+#define NETSYNC_H_  1
+
+#include "nesproj.h"
+
+// Channel and period of the synchronization beacons
+#define SYNC_CH     130
+#define SYNC_PERIOD CLOCK_SECOND*30
+
+// Delay the CU gives to the nodes for an actuation to be executed together,
+// longer than the command retransmissions so a late copy still is on time
+#define SYNC_ACTUATION_DELAY    CLOCK_SECOND
+
+// Longest wait accepted for an execute-at time, anything beyond this is
+// considered already expired
+#define SYNC_MAX_WAIT   CLOCK_SECOND*5
+
+void netsync_open (bool authority);
+// Authority side, the epoch is counted across reboots by the CU
+void netsync_set_epoch (uint8_t epoch);
+bool netsync_is_synced (void);
+clock_time_t netsync_time (void);
+clock_time_t netsync_wait (clock_time_t net_time);
+// Network time as seconds and ticks, the seconds wrap after 18 hours. Before
+// the first beacon it is the clock of the node
+void netsync_stamp (uint16_t* seconds, uint8_t* ticks);
+#endif
@@ -0,0 +1,233 @@
+#include "otaload.h"
+#include "linkstats.h"
+#include "trace.h"
+#include "binlog.h"
+#include "wakes.h"
+#include "cfs/cfs.h"
+#include "cfs/cfs-coffee.h"
+#include "lib/crc16.h"
+#include "loader/elfloader.h"
+#include "sys/autostart.h"
+#include "sys/ctimer.h"
+
+PROCESS(ota_process, "OTA Module Loader Process");
+
+static struct runicast_conn ota_runicast;
+static ota_handler_t ota_handler = NULL;
+static bool ota_loaded = false;
+static ota_msg_t reply;
+
+// Module being received, kept across transfers so that a new BEGIN for the
+// same module resumes it. ota_done once it is loaded
+static uint16_t ota_size = 0;
+static uint16_t ota_crc = 0;
+static uint16_t ota_written = 0;
+static bool ota_done = false;
+
+// A reply waits for the runicast to be free, a newer one replaces it since
+// it carries the state of the transfer at the time it is sent
+static uint8_t reply_type;
+static bool reply_pending = false;
+static struct ctimer reply_timer;
+
+static void ota_reply_send (void* ptr){
+    linkaddr_t cu;
+
+    WAKE_CALLBACK();
+    if (!reply_pending){
+        return;
+    }
+    if (runicast_is_transmitting(&ota_runicast)){
+        ctimer_set(&reply_timer, OTA_RETRY_PERIOD, ota_reply_send, NULL);
+        return;
+    }
+    reply_pending = false;
+    cu.u8[0] = CU_ADDR_0;
+    cu.u8[1] = CU_ADDR_1;
+    reply.hdr = OTA_MSG;
+    reply.type = reply_type;
+    reply.offset = ota_written;
+    reply.size = ota_size;
+    reply.crc = ota_crc;
+    reply.len = 0;
+    packetbuf_copyfrom(&reply, sizeof(reply) - OTA_CHUNK_LEN);
+    TRACE_TX(OTA_CH, &cu);
+    runicast_send(&ota_runicast, &cu, link_prepare(&cu));
+}
+
+static void ota_reply (uint8_t type){
+    reply_type = type;
+    reply_pending = true;
+    ota_reply_send(NULL);
+}
+
+static void ota_write (ota_msg_t* msg){
+    int fd;
+
+    fd = cfs_open(OTA_FILE, CFS_READ | CFS_WRITE);
+    if (fd < 0){
+        return;
+    }
+    if (cfs_seek(fd, msg->offset, CFS_SEEK_SET) == msg->offset &&
+        cfs_write(fd, msg->data, msg->len) == msg->len){
+        ota_written += msg->len;
+    }
+    cfs_close(fd);
+}
+
+static void ota_recv (struct runicast_conn *c, const linkaddr_t *from, uint8_t seqno){
+    ota_msg_t* msg = (ota_msg_t*) packetbuf_dataptr();
+
+    TRACE_RX(OTA_CH, from);
+    if (from->u8[0] != CU_ADDR_0 || from->u8[1] != CU_ADDR_1 || msg->hdr != OTA_MSG){
+        return;
+    }
+    switch (msg->type){
+        case OTA_BEGIN:
+            if (msg->size == 0 || msg->size > OTA_MAX_SIZE){
+                ota_reply(OTA_FAILED);
+                break;
+            }
+
+            // A different module restarts the transfer from scratch
+            if (msg->size != ota_size || msg->crc != ota_crc){
+                ota_size = msg->size;
+                ota_crc = msg->crc;
+                ota_written = 0;
+                ota_done = false;
+                cfs_remove(OTA_FILE);
+                cfs_coffee_reserve(OTA_FILE, OTA_MAX_SIZE);
+            }
+            // The CU has missed the result, the module isn't loaded again
+            if (ota_done){
+                ota_reply(OTA_DONE);
+            }
+            else if (ota_written == ota_size){
+                process_poll(&ota_process);
+            }
+            else {
+                ota_reply(OTA_RESUME);
+            }
+            break;
+
+        case OTA_DATA:
+            // Chunks out of order or not written are dropped, the CU goes on
+            // from ota_written
+            if (msg->offset == ota_written && msg->len <= OTA_CHUNK_LEN &&
+                ota_written + msg->len <= ota_size){
+                ota_write(msg);
+            }
+            if (ota_written == ota_size && ota_size > 0){
+                if (ota_done){
+                    ota_reply(OTA_DONE);
+                }
+                else {
+                    process_poll(&ota_process);
+                }
+            }
+            else {
+                ota_reply(OTA_RESUME);
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
+static void ota_sent (struct runicast_conn *c, const linkaddr_t *to, uint8_t retransmissions){
+    if (reply_pending){
+        ota_reply_send(NULL);
+    }
+}
+
+static void ota_timedout (struct runicast_conn *c, const linkaddr_t *to, uint8_t retransmissions){
+    // The CU sends BEGIN again when it doesn't get an answer, a newer reply
+    // still goes out
+    if (reply_pending){
+        ota_reply_send(NULL);
+    }
+}
+
+static const struct runicast_callbacks ota_calls = {ota_recv, ota_sent, ota_timedout};
+
+static uint16_t ota_file_crc (){
+    uint8_t buf[OTA_CHUNK_LEN];
+    uint16_t left = ota_size;
+    uint16_t crc = 0;
+    int fd;
+    int n;
+
+    fd = cfs_open(OTA_FILE, CFS_READ);
+    if (fd < 0){
+        return ~ota_crc;
+    }
+    while (left > 0 &&
+           (n = cfs_read(fd, buf, (left < sizeof(buf)) ? left : sizeof(buf))) > 0){
+        crc = crc16_data(buf, n, crc);
+        left -= n;
+    }
+    cfs_close(fd);
+    return crc;
+}
+
+static bool ota_load (){
+    int fd;
+    int ret;
+
+    // Only one module at a time, the previous one is stopped first
+    if (ota_loaded){
+        autostart_exit(elfloader_autostart_processes);
+        ota_handler = NULL;
+        ota_loaded = false;
+    }
+    fd = cfs_open(OTA_FILE, CFS_READ);
+    if (fd < 0){
+        return false;
+    }
+    ret = elfloader_load(fd);
+    cfs_close(fd);
+    if (ret != ELFLOADER_OK){
+        BINLOG(LOG_ELF_LOADER, ret, 0);
+        return false;
+    }
+    ota_loaded = true;
+    autostart_start(elfloader_autostart_processes);
+    return true;
+}
+
+void ota_open (){
+    elfloader_init();
+    runicast_open(&ota_runicast, OTA_CH, &ota_calls);
+    process_start(&ota_process, NULL);
+}
+
+void ota_set_handler (ota_handler_t handler){
+    ota_handler = handler;
+}
+
+bool ota_handle (msg_t* msg){
+    return ota_handler != NULL && ota_handler(msg);
+}
+
+PROCESS_THREAD(ota_process, ev, data){
+    PROCESS_EXITHANDLER(runicast_close(&ota_runicast);)
+    PROCESS_BEGIN();
+
+    // Loading takes long, so it isn't done in the Rime callback
+    while (true){
+        PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_POLL);
+        if (ota_file_crc() == ota_crc && ota_load()){
+            ota_done = true;
+            ota_reply(OTA_DONE);
+        }
+        else {
+            // Forget it, so the next BEGIN gets the whole module again
+            ota_size = 0;
+            ota_reply(OTA_FAILED);
+        }
+    }
+
+    PROCESS_END();
+    return 0;
+}
@@ -0,0 +1,61 @@
+/**
+Over the air loading of command handler modules. The CU keeps a Contiki ELF
+module (.ce) received from its serial line and sends it to a node in chunks,
+the node writes it to Coffee, checks its crc and loads it with the ELF loader.
+The node answers every chunk with the offset it has written up to, and the CU
+goes on from there, so a chunk the node couldn't write is sent again. A CU
+left without an answer sends BEGIN again, which the node answers with its
+offset or with the result of the loading: an interrupted transfer is resumed
+from the last chunk written by the node
+**/
+#ifndef OTALOAD_H_
+#define OTALOAD_H_  1
+
+#include "nesproj.h"
+
+// Channel used for the transfers, separate from the commands one
+#define OTA_CH  146
+
+// Coffee file holding the module, on the CU and on the nodes
+#define OTA_FILE    "handler.ce"
+#define OTA_MAX_SIZE    4096
+
+// Bytes of module in every DATA frame
+#define OTA_CHUNK_LEN   32
+
+// A frame finding the runicast busy is tried again after this
+#define OTA_RETRY_PERIOD    (CLOCK_SECOND >> 3)
+
+enum ota_type {
+    OTA_BEGIN,      // CU -> node: size and crc of the module
+    OTA_RESUME,     // node -> CU: offset the transfer has to go on from, the
+                    // answer to BEGIN and to every chunk
+    OTA_DATA,       // CU -> node: a chunk of the module
+    OTA_DONE,       // node -> CU: module loaded
+    OTA_FAILED      // node -> CU: bad crc or the loader refused the module
+};
+
+typedef struct ota_msg_t {
+    uint8_t hdr;
+    uint8_t type;
+    uint16_t offset;
+    uint16_t size;
+    uint16_t crc;
+    uint8_t len;
+    uint8_t data[OTA_CHUNK_LEN];
+} ota_msg_t;
+
+// Handler of the commands the node firmware doesn't know. It returns true if
+// it has handled the command and msg has been changed into the reply
+typedef bool (*ota_handler_t) (msg_t* msg);
+
+// Node side, ota_set_handler() is called by the loaded module
+void ota_open (void);
+void ota_set_handler (ota_handler_t handler);
+bool ota_handle (msg_t* msg);
+
+// CU side, a module is uploaded with tools/ota-upload.sh and sent by writing
+// "ota-send door" or "ota-send gate" on the serial line
+void ota_sender_open (void);
+bool ota_has_handler (const linkaddr_t* node);
+#endif
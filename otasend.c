@@ -0,0 +1,261 @@
+#include "otaload.h"
+#include "linkstats.h"
+#include "trace.h"
+#include "cfs/cfs.h"
+#include "lib/crc16.h"
+#include "dev/serial-line.h"
+
+// The node answers a frame within the runicast retransmissions, without an
+// answer BEGIN is sent again. After OTA_MAX_TRIES timeouts or chunks the node
+// didn't take in a row the transfer is stopped
+#define OTA_REPLY_TIMEOUT   (CLOCK_SECOND * 4)
+#define OTA_MAX_TRIES       5
+
+PROCESS(ota_send_process, "OTA Module Sender Process");
+
+static struct runicast_conn ota_runicast;
+static ota_msg_t out;
+
+// Transfer in progress
+static linkaddr_t ota_dest;
+static uint16_t ota_size;
+static uint16_t ota_crc;
+static uint16_t ota_offset;
+static bool ota_active = false;
+// BEGIN is sent next instead of a chunk
+static bool ota_begin;
+static uint8_t ota_tries;
+
+// Nodes which have a module loaded
+static uint8_t handler_mask = 0x0;
+
+static uint8_t node_mask (const linkaddr_t* node){
+    if (node->u8[0] == DOOR_ADDR_0 && node->u8[1] == DOOR_ADDR_1){
+        return 0x01;
+    }
+    if (node->u8[0] == GATE_ADDR_0 && node->u8[1] == GATE_ADDR_1){
+        return 0x02;
+    }
+    return 0x0;
+}
+
+static void ota_recv (struct runicast_conn *c, const linkaddr_t *from, uint8_t seqno){
+    ota_msg_t* msg = (ota_msg_t*) packetbuf_dataptr();
+
+    TRACE_RX(OTA_CH, from);
+    if (msg->hdr != OTA_MSG || !ota_active || !linkaddr_cmp(from, &ota_dest)){
+        return;
+    }
+    switch (msg->type){
+        case OTA_RESUME:
+            // Only the node moves the transfer on, a chunk it couldn't write
+            // is sent again. A node which has forgotten the module, e.g.
+            // after a reboot, gets BEGIN again
+            if (msg->size != ota_size || msg->crc != ota_crc){
+                ota_begin = true;
+                ++ota_tries;
+            }
+            else if (out.type == OTA_BEGIN || msg->offset > ota_offset){
+                if (out.type == OTA_BEGIN){
+                    printf("OTA: sending from %u of %u bytes\n", msg->offset, ota_size);
+                }
+                if (msg->offset > ota_offset){
+                    ota_tries = 0;
+                }
+                ota_offset = msg->offset;
+                ota_begin = false;
+            }
+            else {
+                ++ota_tries;
+            }
+            process_poll(&ota_send_process);
+            break;
+
+        case OTA_DONE:
+            handler_mask |= node_mask(from);
+            ota_active = false;
+            printf("OTA: module loaded by node %d.%d\n", from->u8[0], from->u8[1]);
+            break;
+
+        case OTA_FAILED:
+            handler_mask &= ~node_mask(from);
+            ota_active = false;
+            printf("OTA: node %d.%d refused the module\n", from->u8[0], from->u8[1]);
+            break;
+
+        default:
+            break;
+    }
+}
+
+static void ota_sent (struct runicast_conn *c, const linkaddr_t *to, uint8_t retransmissions){
+    // Do nothing, the node tells where it is
+}
+
+static void ota_timedout (struct runicast_conn *c, const linkaddr_t *to, uint8_t retransmissions){
+    // Do nothing, the missing answer sends BEGIN again
+}
+
+static const struct runicast_callbacks ota_calls = {ota_recv, ota_sent, ota_timedout};
+
+// Size and crc of the module stored on the CU, false if there is none
+static bool ota_file_info (){
+    uint8_t buf[OTA_CHUNK_LEN];
+    int fd;
+    int n;
+
+    fd = cfs_open(OTA_FILE, CFS_READ);
+    if (fd < 0){
+        return false;
+    }
+    ota_size = 0;
+    ota_crc = 0;
+    while ((n = cfs_read(fd, buf, sizeof(buf))) > 0){
+        ota_crc = crc16_data(buf, n, ota_crc);
+        ota_size += n;
+    }
+    cfs_close(fd);
+    return ota_size > 0 && ota_size <= OTA_MAX_SIZE;
+}
+
+static void ota_send_chunk (){
+    int fd;
+    int n = -1;
+
+    fd = cfs_open(OTA_FILE, CFS_READ);
+    if (fd >= 0){
+        if (cfs_seek(fd, ota_offset, CFS_SEEK_SET) == ota_offset){
+            n = cfs_read(fd, out.data, OTA_CHUNK_LEN);
+        }
+        cfs_close(fd);
+    }
+    if (n <= 0){
+        ota_active = false;
+        printf("OTA: module unreadable at %u, transfer stopped\n", ota_offset);
+        return;
+    }
+    out.hdr = OTA_MSG;
+    out.type = OTA_DATA;
+    out.offset = ota_offset;
+    out.len = n;
+    packetbuf_copyfrom(&out, sizeof(out) - OTA_CHUNK_LEN + n);
+    TRACE_TX(OTA_CH, &ota_dest);
+    runicast_send(&ota_runicast, &ota_dest, link_prepare(&ota_dest));
+}
+
+static void ota_send_begin (){
+    out.hdr = OTA_MSG;
+    out.type = OTA_BEGIN;
+    out.size = ota_size;
+    out.crc = ota_crc;
+    out.len = 0;
+    packetbuf_copyfrom(&out, sizeof(out) - OTA_CHUNK_LEN);
+    TRACE_TX(OTA_CH, &ota_dest);
+    runicast_send(&ota_runicast, &ota_dest, link_prepare(&ota_dest));
+}
+
+static uint8_t hex_value (char c){
+    if (c >= '0' && c <= '9'){
+        return c - '0';
+    }
+    return (c | 0x20) - 'a' + 10;
+}
+
+// Append a line of hex bytes to the module stored on the CU
+static void ota_append (const char* hex){
+    uint8_t buf[OTA_CHUNK_LEN];
+    uint8_t n = 0;
+    int fd;
+
+    while (hex[0] != '\0' && hex[1] != '\0' && n < sizeof(buf)){
+        buf[n++] = (hex_value(hex[0]) << 4) | hex_value(hex[1]);
+        hex += 2;
+    }
+    fd = cfs_open(OTA_FILE, CFS_WRITE | CFS_APPEND);
+    if (fd >= 0){
+        cfs_write(fd, buf, n);
+        cfs_close(fd);
+    }
+}
+
+void ota_sender_open (){
+    runicast_open(&ota_runicast, OTA_CH, &ota_calls);
+    process_start(&ota_send_process, NULL);
+}
+
+bool ota_has_handler (const linkaddr_t* node){
+    return (handler_mask & node_mask(node)) != 0;
+}
+
+PROCESS_THREAD(ota_send_process, ev, data){
+    static char* line;
+    static struct etimer retry_timer;
+    static struct etimer reply_timer;
+
+    PROCESS_EXITHANDLER(runicast_close(&ota_runicast);)
+    PROCESS_BEGIN();
+
+    while (true){
+        PROCESS_WAIT_EVENT();
+        if (ev == PROCESS_EVENT_TIMER && data == &reply_timer && ota_active){
+            ++ota_tries;
+            ota_begin = true;
+        }
+        if (ota_active && ota_tries >= OTA_MAX_TRIES){
+            ota_active = false;
+            printf("OTA: transfer stopped at %u of %u bytes, send again to resume\n",
+                   ota_offset, ota_size);
+        }
+        if ((ev == PROCESS_EVENT_POLL || (ev == PROCESS_EVENT_TIMER &&
+             (data == &retry_timer || data == &reply_timer))) && ota_active){
+            if (runicast_is_transmitting(&ota_runicast)){
+                // The poll is gone, without the retry the transfer stalls
+                etimer_set(&retry_timer, OTA_RETRY_PERIOD);
+            }
+            else {
+                if (ota_begin){
+                    ota_send_begin();
+                }
+                else {
+                    ota_send_chunk();
+                }
+                etimer_set(&reply_timer, OTA_REPLY_TIMEOUT);
+            }
+        }
+        if (ev == serial_line_event_message){
+            line = (char*) data;
+            if (strcmp(line, "ota-clear") == 0){
+                cfs_remove(OTA_FILE);
+            }
+            else if (strncmp(line, "ota-data ", 9) == 0){
+                ota_append(line + 9);
+            }
+            else if (strncmp(line, "ota-send ", 9) == 0 && ota_active){
+                printf("OTA: transfer in progress\n");
+            }
+            else if (strncmp(line, "ota-send ", 9) == 0){
+                if (strcmp(line + 9, "door") == 0){
+                    ota_dest.u8[0] = DOOR_ADDR_0;
+                    ota_dest.u8[1] = DOOR_ADDR_1;
+                }
+                else {
+                    ota_dest.u8[0] = GATE_ADDR_0;
+                    ota_dest.u8[1] = GATE_ADDR_1;
+                }
+                if (ota_file_info()){
+                    ota_active = true;
+                    ota_begin = true;
+                    ota_offset = 0;
+                    ota_tries = 0;
+                    process_poll(&ota_send_process);
+                }
+                else {
+                    printf("OTA: no module to send\n");
+                }
+            }
+        }
+    }
+
+    PROCESS_END();
+    return 0;
+}
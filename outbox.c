@@ -0,0 +1,67 @@
+#include "outbox.h"
+#include "linkstats.h"
+#include "binlog.h"
+#include "wakes.h"
+#include "sys/ctimer.h"
+
+#if (OUTBOX_LEN & (OUTBOX_LEN - 1)) != 0 || OUTBOX_LEN > 128
+#error "OUTBOX_LEN must be a power of two up to 128"
+#endif
+
+static msg_t queue[OUTBOX_LEN];
+// Free running indexes, head - tail messages are waiting
+static uint8_t head = 0;
+static uint8_t tail = 0;
+static uint16_t lost = 0;
+static msg_t last_reply;
+static outbox_send_t outbox_send;
+static const linkaddr_t* outbox_dest;
+static struct ctimer retry_timer;
+
+static void outbox_flush (void* ptr){
+    WAKE_CALLBACK();
+    while (head != tail){
+        if (outbox_send(&queue[tail % OUTBOX_LEN]) != 0){
+            ctimer_set(&retry_timer, link_backoff(outbox_dest, CLOCK_SECOND >> 2),
+                       outbox_flush, NULL);
+            return;
+        }
+        ++tail;
+    }
+}
+
+void outbox_open (outbox_send_t send, const linkaddr_t* dest){
+    outbox_send = send;
+    outbox_dest = dest;
+}
+
+bool outbox_put (const msg_t* msg){
+    if ((uint8_t) (head - tail) == OUTBOX_LEN){
+        BINLOG(LOG_OUTBOX_FULL, msg->hdr, ++lost);
+        return false;
+    }
+    queue[head++ % OUTBOX_LEN] = *msg;
+    if (msg->seq != 0){
+        last_reply = *msg;
+    }
+
+    // Messages behind one waiting for the radio go with its retry
+    if ((uint8_t) (head - tail) == 1){
+        outbox_flush(NULL);
+    }
+    return true;
+}
+
+bool outbox_resend (uint8_t seq){
+    uint8_t i;
+
+    if (seq == 0 || last_reply.seq != seq){
+        return false;
+    }
+    for (i = tail; i != head; ++i){
+        if (queue[i % OUTBOX_LEN].seq == seq){
+            return false;
+        }
+    }
+    return outbox_put(&last_reply);
+}
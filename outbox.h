@@ -0,0 +1,29 @@
+/**
+Messages of an actuator waiting for the radio. Every reply, report and digest
+for the CU is queued here and sent in order, a message finding the runicast
+busy is tried again after the link backoff by a ctimer, so the dispatcher of
+the node never blocks waiting for the radio
+**/
+#ifndef OUTBOX_H_
+#define OUTBOX_H_  1
+
+#include "nesproj.h"
+
+// The end of an opening alone queues the close, an alarm ack, a scene report,
+// a digest and an alert, with room for a command reply on top of them. The
+// indexes are free running, a power of two
+#ifndef OUTBOX_LEN
+#define OUTBOX_LEN  8
+#endif
+
+// send returns 0 once the message is on the air, 1 if the radio is busy
+typedef uint8_t (*outbox_send_t) (msg_t* msg);
+
+void outbox_open (outbox_send_t send, const linkaddr_t* dest);
+// The message is copied, false if the outbox is full and it is lost
+bool outbox_put (const msg_t* msg);
+// The last message with a seq is kept: a command retransmitted because its
+// reply was lost is answered again with it. False if there is no reply to
+// seq, the command is still being run or its reply is still queued
+bool outbox_resend (uint8_t seq);
+#endif
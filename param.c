@@ -0,0 +1,148 @@
+#include "param.h"
+#include "cfs/cfs.h"
+#include "lib/crc16.h"
+
+struct param_def {
+    const char* name;
+    uint8_t type;
+    uint8_t nodes;
+    int16_t min;
+    int16_t max;
+    int16_t def;
+};
+
+// Defaults are the values the nodes were built with. The sample period has
+// to be a multiple of the anomaly detector one, it is rounded down by the Door
+static const struct param_def params[PARAM_NUM] = {
+    {"blink-ms",    PARAM_MILLISECONDS, PARAM_DOOR | PARAM_GATE,    250, 8000,  2000},
+    {"open-s",      PARAM_SECONDS,      PARAM_DOOR | PARAM_GATE,    4,   120,   16},
+    {"smpl-s",      PARAM_SECONDS,      PARAM_DOOR | PARAM_CU,      2,   120,   SMPL_TEMP_PERIOD_SECONDS},
+    {"retx",        PARAM_COUNT,        PARAM_DOOR | PARAM_GATE | PARAM_CU, 1, 8, MAX_RETRANSMISSIONS},
+    {"cmd-ms",      PARAM_MILLISECONDS, PARAM_CU,                   1000, 10000, 4000},
+    {"monitor-ms",  PARAM_MILLISECONDS, PARAM_CU,                   500, 10000, 2000},
+    {"cmd-retx",    PARAM_COUNT,        PARAM_CU,                   0,   10,    3}
+};
+
+// Header of the saved values, as the checkpoint one (persist.c)
+struct param_hdr {
+    uint8_t num;
+    uint8_t node;
+    uint16_t crc;
+};
+
+static int16_t values[PARAM_NUM];
+static uint8_t this_node;
+
+static bool param_load (){
+    struct param_hdr hdr;
+    int16_t saved[PARAM_NUM];
+    uint8_t i;
+    int fd;
+    bool valid;
+
+    fd = cfs_open(PARAM_FILE, CFS_READ);
+    if (fd < 0){
+        return false;
+    }
+    valid = cfs_read(fd, &hdr, sizeof(hdr)) == sizeof(hdr) &&
+            hdr.num == PARAM_NUM && hdr.node == this_node &&
+            cfs_read(fd, saved, sizeof(saved)) == sizeof(saved) &&
+            crc16_data((const unsigned char*) saved, sizeof(saved), 0) == hdr.crc;
+    cfs_close(fd);
+    if (!valid){
+        return false;
+    }
+    // Ranges may have changed since they were saved
+    for (i = 0; i < PARAM_NUM; ++i){
+        param_set(i, saved[i]);
+    }
+    return true;
+}
+
+void param_init (uint8_t node){
+    uint8_t i;
+
+    this_node = node;
+    for (i = 0; i < PARAM_NUM; ++i){
+        values[i] = params[i].def;
+    }
+    param_load();
+}
+
+int16_t param_get (uint8_t id){
+    return values[id];
+}
+
+clock_time_t param_ticks (uint8_t id){
+    if (params[id].type == PARAM_MILLISECONDS){
+        return (clock_time_t) ((uint32_t) values[id] * CLOCK_SECOND / 1000);
+    }
+    return (clock_time_t) values[id] * CLOCK_SECOND;
+}
+
+bool param_on (uint8_t id, uint8_t node){
+    return id < PARAM_NUM && (params[id].nodes & node) != 0;
+}
+
+bool param_set (uint8_t id, int16_t value){
+    if (!param_on(id, this_node) || value < params[id].min || value > params[id].max){
+        return false;
+    }
+    values[id] = value;
+    return true;
+}
+
+bool param_save (){
+    struct param_hdr hdr;
+    int fd;
+    bool written;
+
+    hdr.num = PARAM_NUM;
+    hdr.node = this_node;
+    hdr.crc = crc16_data((const unsigned char*) values, sizeof(values), 0);
+    fd = cfs_open(PARAM_FILE, CFS_WRITE);
+    if (fd < 0){
+        return false;
+    }
+    written = cfs_write(fd, &hdr, sizeof(hdr)) == sizeof(hdr) &&
+              cfs_write(fd, values, sizeof(values)) == sizeof(values);
+    cfs_close(fd);
+    return written;
+}
+
+int8_t param_find (const char* name){
+    uint8_t i;
+
+    for (i = 0; i < PARAM_NUM; ++i){
+        if (strcmp(params[i].name, name) == 0){
+            return i;
+        }
+    }
+    return -1;
+}
+
+const char* param_name (uint8_t id){
+    return (id < PARAM_NUM) ? params[id].name : "?";
+}
+
+void param_print (){
+    uint8_t i;
+
+    for (i = 0; i < PARAM_NUM; ++i){
+        if (params[i].nodes & this_node){
+            printf("Param %s = %d (%d..%d, default %d)\n", params[i].name, values[i],
+                   params[i].min, params[i].max, params[i].def);
+        }
+    }
+}
+
+void param_handle (msg_t* msg){
+    enum param_op op = PARAM_REQUEST_OP(msg->time);
+    uint8_t id = PARAM_REQUEST_ID(msg->time);
+
+    if (op != PARAM_GET && param_set(id, (int16_t) msg->payload) && op == PARAM_SET_SAVE){
+        param_save();
+    }
+    // A parameter this node doesn't have is answered with INT16_MIN
+    msg->payload = param_on(id, this_node) ? (uint16_t) values[id] : (uint16_t) INT16_MIN;
+}
@@ -0,0 +1,63 @@
+/**
+Runtime parameters of the nodes. Every node keeps a table of typed values
+with their range, starting from the compile time defaults and from the values
+saved in flash, if any. The CU reads and changes them over the air with
+PARAM_MSG frames: the time field of a request carries the operation and the
+parameter, the payload the new value; the reply carries the value in use, so
+a refused one comes back unchanged
+**/
+#ifndef PARAM_H_
+#define PARAM_H_  1
+
+#include "nesproj.h"
+
+#define PARAM_FILE  "params.cfg"
+
+// Nodes a parameter exists on
+#define PARAM_DOOR  0x01
+#define PARAM_GATE  0x02
+#define PARAM_CU    0x04
+
+enum param_id {
+    PARAM_BLINK_MS,     // period of the blinking leds
+    PARAM_OPEN_SECONDS, // how long the entrance stays open
+    PARAM_SMPL_SECONDS, // period of the samples in the temperature window
+    PARAM_MAX_RETX,     // cap of the runicast retransmissions
+    PARAM_CMD_MS,       // button presses of a command on the CU
+    PARAM_MONITOR_MS,   // how long a result is shown before the menu
+    PARAM_CMD_RETX,     // retransmissions of a command by the CU
+    PARAM_NUM
+};
+
+enum param_type {
+    PARAM_MILLISECONDS,
+    PARAM_SECONDS,
+    PARAM_COUNT
+};
+
+enum param_op {
+    PARAM_GET,
+    PARAM_SET,
+    PARAM_SET_SAVE      // set and write every parameter of the node to flash
+};
+
+#define PARAM_REQUEST(op, id)   ((uint16_t) ((op) << 8 | (id)))
+#define PARAM_REQUEST_OP(t)     ((enum param_op) ((t) >> 8))
+#define PARAM_REQUEST_ID(t)     ((uint8_t) ((t) & 0xFF))
+
+void param_init (uint8_t node);
+int16_t param_get (uint8_t id);
+// Values in milliseconds or seconds as clock ticks
+clock_time_t param_ticks (uint8_t id);
+// Returns false if the parameter isn't on this node or the value is out of
+// range, the value in use is left as it is
+bool param_set (uint8_t id, int16_t value);
+bool param_save (void);
+bool param_on (uint8_t id, uint8_t node);
+int8_t param_find (const char* name);
+const char* param_name (uint8_t id);
+void param_print (void);
+
+// Node side: turns a PARAM_MSG from the CU into its reply
+void param_handle (msg_t* msg);
+#endif
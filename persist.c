@@ -0,0 +1,75 @@
+#include "persist.h"
+#include "cfs/cfs.h"
+#include "cfs/cfs-coffee.h"
+#include "lib/crc16.h"
+
+// Header written before the checkpoint, a checkpoint with a different version
+// or length (i.e. written by another firmware) or a bad crc is discarded
+struct persist_hdr {
+    uint8_t version;
+    uint8_t len;
+    uint16_t crc;
+};
+
+static uint16_t last_crc;
+static bool last_crc_valid = false;
+static uint16_t persist_writes = 0;
+static uint32_t persist_bytes = 0;
+
+bool persist_load (void* data, uint16_t len){
+    struct persist_hdr hdr;
+    int fd;
+    bool valid = false;
+
+    fd = cfs_open(PERSIST_FILE, CFS_READ);
+    if (fd < 0){
+        return false;
+    }
+    if (cfs_read(fd, &hdr, sizeof(hdr)) == sizeof(hdr) &&
+        hdr.version == PERSIST_VERSION && hdr.len == len &&
+        cfs_read(fd, data, len) == len &&
+        crc16_data((const unsigned char*) data, len, 0) == hdr.crc){
+        last_crc = hdr.crc;
+        last_crc_valid = true;
+        valid = true;
+    }
+    cfs_close(fd);
+    return valid;
+}
+
+bool persist_store (const void* data, uint16_t len){
+    struct persist_hdr hdr;
+    int fd;
+    bool written;
+
+    // Don't wear the flash for a checkpoint equal to the one already written
+    hdr.version = PERSIST_VERSION;
+    hdr.len = len;
+    hdr.crc = crc16_data((const unsigned char*) data, len, 0);
+    if (last_crc_valid && hdr.crc == last_crc){
+        return true;
+    }
+
+    // Reserving the whole file the first time avoids Coffee to move it when
+    // it grows
+    if (!last_crc_valid){
+        cfs_coffee_reserve(PERSIST_FILE, sizeof(hdr) + PERSIST_MAX_LEN);
+    }
+    fd = cfs_open(PERSIST_FILE, CFS_WRITE);
+    if (fd < 0){
+        return false;
+    }
+    written = cfs_write(fd, &hdr, sizeof(hdr)) == sizeof(hdr) &&
+              cfs_write(fd, data, len) == len;
+    cfs_close(fd);
+    last_crc = hdr.crc;
+    last_crc_valid = written;
+
+    ++persist_writes;
+    persist_bytes += sizeof(hdr) + len;
+    if (persist_writes % PERSIST_REPORT_WRITES == 0){
+        printf("Checkpoint: %u writes, %lu bytes to flash in %lu s\n",
+               persist_writes, (unsigned long) persist_bytes, clock_seconds());
+    }
+    return written;
+}
@@ -0,0 +1,24 @@
+/**
+Checkpoint of the node state in flash. It is stored in a Coffee file so that
+a node restarts from where it was instead of from the defaults
+**/
+#ifndef PERSIST_H_
+#define PERSIST_H_  1
+
+#include "nesproj.h"
+
+#define PERSIST_FILE    "nesproj.ckpt"
+// To be increased every time the layout of a checkpoint changes
+#define PERSIST_VERSION 3
+#define PERSIST_MAX_LEN 32
+
+// Temperature samples are written in batches to limit the flash wear, state
+// changes are written right away
+#define PERSIST_SMPL_BATCH  SMPL_NUM
+
+// The flash write rate is printed every PERSIST_REPORT_WRITES writes
+#define PERSIST_REPORT_WRITES   16
+
+bool persist_load (void* data, uint16_t len);
+bool persist_store (const void* data, uint16_t len);
+#endif
@@ -1,8 +1,45 @@
-#ifndef PROJECT_CONF_H_
-#define PROJECT_CONF_H_
-
-// Use CSMA/CA null Radio Duty Cycle
-#undef NETSTACK_CONF_RDC
-#define NETSTACK_CONF_RDC nullrdc_driver
-
-#endif /* PROJECT_CONF_H_ */
+#ifndef PROJECT_CONF_H_
+#define PROJECT_CONF_H_
+
+// Use CSMA/CA null Radio Duty Cycle
+#undef NETSTACK_CONF_RDC
+#define NETSTACK_CONF_RDC nullrdc_driver
+
+#if LINK_IMPAIR
+// Received frames go through the link impairment (impair.h) before csma
+#undef NETSTACK_CONF_MAC
+#define NETSTACK_CONF_MAC impair_mac_driver
+#endif
+
+#if CU_COAP
+// The actuators speak Rime, so does the radio of the CU: IPv6 is routed to
+// the SLIP fallback interface and never reaches 6LoWPAN
+#undef NETSTACK_CONF_NETWORK
+#define NETSTACK_CONF_NETWORK rime_driver
+#undef LINKADDR_CONF_SIZE
+#define LINKADDR_CONF_SIZE 2
+#define UIP_FALLBACK_INTERFACE cucoap_slip
+#undef UIP_CONF_IPV6_RPL
+#define UIP_CONF_IPV6_RPL 0
+#undef UIP_CONF_TCP
+#define UIP_CONF_TCP 0
+#undef UIP_CONF_BUFFER_SIZE
+#define UIP_CONF_BUFFER_SIZE 240
+#undef UIP_CONF_MAX_ROUTES
+#define UIP_CONF_MAX_ROUTES 0
+#undef NBR_TABLE_CONF_MAX_NEIGHBORS
+#define NBR_TABLE_CONF_MAX_NEIGHBORS 2
+
+// CoAP sized for three clients and the small JSON payloads of cucoap.c
+#undef REST_MAX_CHUNK_SIZE
+#define REST_MAX_CHUNK_SIZE 64
+#undef COAP_MAX_OPEN_TRANSACTIONS
+#define COAP_MAX_OPEN_TRANSACTIONS 2
+#undef COAP_MAX_OBSERVERS
+#define COAP_MAX_OBSERVERS 3
+
+// RAM given up by the reading history for the IPv6 buffers
+#define HISTORY_BYTES 256
+#endif
+
+#endif /* PROJECT_CONF_H_ */
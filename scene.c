@@ -0,0 +1,108 @@
+#include "scene.h"
+
+void scene_start (struct scene* s, const msg_t* msg){
+    s->steps = msg->payload;
+    s->time = msg->time;
+    s->report = 0;
+    s->seq = msg->seq;
+    s->next = 0;
+    s->active = true;
+}
+
+bool scene_advance (struct scene* s, scene_step_t step){
+    enum scene_result result;
+    uint8_t action;
+
+    if (!s->active){
+        return false;
+    }
+    while (s->next < SCENE_STEPS){
+        action = SCENE_STEP(s->steps, s->next);
+        if (action == SCENE_END){
+            break;
+        }
+        result = step((enum message) action, s->time);
+        if (result == SCENE_WAIT){
+            return false;
+        }
+        s->report |= (uint16_t) result << (s->next * 2);
+        ++s->next;
+    }
+    s->active = false;
+    return true;
+}
+
+msg_t scene_report (const struct scene* s){
+    msg_t msg = set_message(SCENE_MSG, s->report);
+    set_seq(&msg, s->seq);
+    return msg;
+}
+
+uint16_t scene_merge (uint16_t a, uint16_t b){
+    enum scene_result ra, rb;
+    uint16_t merged = 0;
+    uint8_t i;
+
+    for (i = 0; i < SCENE_STEPS; ++i){
+        ra = SCENE_RESULT(a, i);
+        rb = SCENE_RESULT(b, i);
+        if (ra == SCENE_FAILED || rb == SCENE_FAILED){
+            ra = SCENE_FAILED;
+        }
+        else if (rb == SCENE_DONE){
+            ra = SCENE_DONE;
+        }
+        merged |= (uint16_t) ra << (i * 2);
+    }
+    return merged;
+}
+
+static const struct {
+    const char* name;
+    uint8_t action;
+} scene_actions[] = {
+    {"arm",         ALARM_ENABLED},
+    {"disarm",      ALARM_DISABLED},
+    {"lock",        GATE_LOCK},
+    {"unlock",      GATE_UNLOCK},
+    {"open",        ENTRANCE_OPEN},
+    {"close",       ENTRANCE_CLOSE},
+    {"hvac-on",     HVAC_ON},
+    {"hvac-off",    HVAC_OFF}
+};
+
+#define SCENE_ACTION_NUM    (sizeof(scene_actions) / sizeof(scene_actions[0]))
+
+const char* scene_action_name (uint8_t action){
+    uint8_t i;
+
+    for (i = 0; i < SCENE_ACTION_NUM; ++i){
+        if (scene_actions[i].action == action){
+            return scene_actions[i].name;
+        }
+    }
+    return "?";
+}
+
+// Space separated action names, "close lock arm"
+bool scene_parse (char* text, uint16_t* steps){
+    uint16_t parsed = 0xFFFF;
+    uint8_t n = 0;
+    uint8_t i;
+    char* name;
+
+    for (name = strtok(text, " "); name != NULL; name = strtok(NULL, " ")){
+        for (i = 0; i < SCENE_ACTION_NUM && strcmp(scene_actions[i].name, name) != 0; ++i);
+        if (i == SCENE_ACTION_NUM || n == SCENE_STEPS){
+            return false;
+        }
+        parsed &= ~((uint16_t) 0x0F << (n * 4));
+        parsed |= (uint16_t) scene_actions[i].action << (n * 4);
+        ++n;
+    }
+    if (n == 0){
+        return false;
+    }
+    *steps = parsed;
+    return true;
+}
@@ -0,0 +1,53 @@
+/**
+Scenes: a few actions sent to the actuators in a single SCENE_MSG frame. The
+payload holds up to SCENE_STEPS actions (enum message), four bits each from
+the low nibble, SCENE_END after the last one; time is when ENTRANCE_OPEN
+starts, as in the plain command. Every actuator runs the steps in order,
+waiting for the precondition of a step (the entrance closed) before going on,
+and answers once with a SCENE_MSG carrying the result of every step, two bits
+each. It depends only on nesproj.h (see bench/)
+**/
+#ifndef SCENE_H_
+#define SCENE_H_  1
+
+#include "nesproj.h"
+
+#define SCENE_STEPS 4
+#define SCENE_END   0x0F
+#define SCENE_STEP(steps, i)    ((uint8_t) (((steps) >> ((i) * 4)) & 0x0F))
+#define SCENE_RESULT(report, i) ((enum scene_result) (((report) >> ((i) * 2)) & 0x03))
+#define SCENE_PACK(a, b, c, d)  ((uint16_t) ((a) | (b) << 4 | (c) << 8 | (d) << 12))
+
+// ENTRANCE_CLOSE as a step waits for the entrance to be closed
+enum scene_result {
+    SCENE_SKIPPED,      // not for this node
+    SCENE_DONE,
+    SCENE_FAILED,
+    SCENE_WAIT          // precondition not met yet, the step is tried again
+};
+
+struct scene {
+    uint16_t steps;
+    uint16_t time;
+    uint16_t report;
+    uint8_t seq;
+    uint8_t next;
+    bool active;
+};
+
+// Runs one step on the node
+typedef enum scene_result (*scene_step_t) (enum message action, uint16_t time);
+
+// Node side. scene_advance() is called when the scene arrives and after
+// every state change that may satisfy a precondition, it returns true once
+// the last step has run and the report has to be sent
+void scene_start (struct scene* s, const msg_t* msg);
+bool scene_advance (struct scene* s, scene_step_t step);
+msg_t scene_report (const struct scene* s);
+
+// CU side: reports of more nodes merged step by step, a failure wins over a
+// success and a success over a skip. Actions are named as on the serial line
+uint16_t scene_merge (uint16_t a, uint16_t b);
+bool scene_parse (char* text, uint16_t* steps);
+const char* scene_action_name (uint8_t action);
+#endif
@@ -0,0 +1,78 @@
+#!/usr/bin/env python3
+"""Expand the binary log records of the nodes into text.
+
+Reads a serial or Cooja log and rewrites every "#L <seconds> <record> <arg>
+<arg>" line with the format string of the record from binlog-ids.h, leaving
+the rest of the log and whatever precedes the record on its line (e.g. the
+Cooja time and mote id) untouched.
+
+    make login | tools/binlog-decode.py
+    tools/binlog-decode.py COOJA.testlog
+"""
+
+import argparse
+import os
+import re
+import sys
+
+RECORD = re.compile(r"#L (\d+) (\d+) (-?\d+) (-?\d+)\s*$")
+ID = re.compile(r'^BINLOG_ID\(\s*(\w+)\s*,\s*"((?:[^"\\]|\\.)*)"\s*\)')
+SPEC = re.compile(r"%[da]")
+
+
+def load_formats(path):
+    formats = []
+    with open(path) as f:
+        for line in f:
+            m = ID.match(line.strip())
+            if m:
+                formats.append((m.group(1), m.group(2)))
+    return formats
+
+
+def expand(fmt, args):
+    args = iter(args)
+
+    def arg(m):
+        value = next(args)
+        if m.group(0) == "%a":
+            value &= 0xFFFF
+            return "%d.%d" % (value >> 8, value & 0xFF)
+        return str(value)
+
+    return SPEC.sub(arg, fmt)
+
+
+def decode(line, formats):
+    m = RECORD.search(line)
+    if not m:
+        return line
+    seconds, ident, a, b = (int(g) for g in m.groups())
+    if ident < len(formats):
+        text = "%s %s" % (formats[ident][0], expand(formats[ident][1], (a, b)))
+    else:
+        text = "unknown record %d: %d %d" % (ident, a, b)
+    return "%s[%us] %s\n" % (line[:m.start()], seconds, text)
+
+
+def main():
+    repo = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("log", nargs="?", help="log file, standard input if missing")
+    parser.add_argument("--ids", default=os.path.join(repo, "binlog-ids.h"),
+                        help="record table the firmware was built with")
+    args = parser.parse_args()
+
+    formats = load_formats(args.ids)
+    source = open(args.log) if args.log else sys.stdin
+    try:
+        for line in source:
+            sys.stdout.write(decode(line, formats))
+            sys.stdout.flush()
+    finally:
+        if args.log:
+            source.close()
+
+
+if __name__ == "__main__":
+    main()
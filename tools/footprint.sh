@@ -0,0 +1,60 @@
+#!/bin/sh
+# RAM/ROM footprint of a node image: breakdown per object and per symbol, then
+# the totals are checked against RAM_BUDGET and ROM_BUDGET (bytes). It only
+# warns when a budget is exceeded unless FOOTPRINT_STRICT=1.
+#
+# usage: footprint.sh <image> <object|archive>...
+
+SIZE=${SIZE:-msp430-size}
+NM=${NM:-msp430-nm}
+RAM_BUDGET=${RAM_BUDGET:-10240}
+ROM_BUDGET=${ROM_BUDGET:-49152}
+FOOTPRINT_TOP=${FOOTPRINT_TOP:-25}
+FOOTPRINT_STRICT=${FOOTPRINT_STRICT:-0}
+
+if [ $# -lt 1 ]; then
+    echo "usage: $0 <image> <object|archive>..." >&2
+    exit 2
+fi
+image=$1
+shift
+
+echo "==== $image"
+
+# Per object, ROM is text + data and RAM is data + bss
+if [ $# -gt 0 ]; then
+    echo "---- per object"
+    $SIZE "$@" | awk 'NR > 1 && $1 ~ /^[0-9]+$/ {
+        printf "%7d ROM %7d RAM  %s\n", $1 + $2, $2 + $3, $6
+    }' | sort -rn
+fi
+
+# Per symbol, biggest first
+echo "---- top $FOOTPRINT_TOP symbols"
+$NM --size-sort -S -r "$image" | awk -v top="$FOOTPRINT_TOP" '
+function hex2dec(h,    i, d) {
+    d = 0
+    h = tolower(h)
+    for (i = 1; i <= length(h); ++i) {
+        d = d * 16 + index("0123456789abcdef", substr(h, i, 1)) - 1
+    }
+    return d
+}
+NF == 4 && n < top {
+    t = tolower($3)
+    mem = (t == "b") ? "RAM" : (t == "d") ? "RAM+ROM" : "ROM"
+    printf "%7d %-8s %s\n", hex2dec($2), mem, $4
+    ++n
+}'
+
+# Totals of the whole image
+$SIZE "$image" | awk -v ram_budget="$RAM_BUDGET" -v rom_budget="$ROM_BUDGET" \
+                     -v strict="$FOOTPRINT_STRICT" 'NR == 2 {
+    rom = $1 + $2
+    ram = $2 + $3
+    printf "---- total %d/%d ROM, %d/%d RAM\n", rom, rom_budget, ram, ram_budget
+    over = 0
+    if (rom > rom_budget) { print "WARNING: ROM budget exceeded"; over = 1 }
+    if (ram > ram_budget) { print "WARNING: RAM budget exceeded"; over = 1 }
+    exit (over && strict == 1) ? 1 : 0
+}'
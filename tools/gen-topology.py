@@ -0,0 +1,200 @@
+#!/usr/bin/env python3
+"""Generate a Cooja simulation with a Central Unit in stress mode and N
+Door/Gate style actuators spread at random around it.
+
+The CU keeps its fixed address, actuators get the addresses from 1 skipping
+the CU one: odd addresses run the Door firmware, even ones the Gate firmware
+(the convention CentralUnit.c uses in stress mode). The simulation script logs
+the STRESS reports of the CU and stops after the given time.
+
+Any of --loss, --latency, --jitter, --dup and --reorder builds every node with
+the link impairment of impair.h, seeded with the simulation seed. --loss 0
+builds it too, for a lossless baseline that still counts the frames sent. --wakes
+builds every node with the wake counters of wakes.h and logs their WAKES
+reports too.
+
+    tools/gen-topology.py -n 16 -d 20 -r 4 -t 300 -o stress-16.csc
+    tools/gen-topology.py -n 4 --loss 100 --model gilbert -o lossy-4.csc
+    tools/gen-topology.py -n 4 --wakes -t 600 -o wakes-4.csc
+"""
+
+import argparse
+import math
+import os
+import random
+import sys
+
+CU_ADDR = 3
+
+IMPAIR_OBJECTS = ("obj_sky/impair.o obj_sky/impairmac.o obj_sky/netstack.o "
+                  "obj_sky/contiki-sky-main.o obj_sky/wakes.o contiki-sky.a")
+
+SKY_INTERFACES = [
+    "org.contikios.cooja.interfaces.Position",
+    "org.contikios.cooja.interfaces.RimeAddress",
+    "org.contikios.cooja.interfaces.Mote2MoteRelations",
+    "org.contikios.cooja.interfaces.MoteAttributes",
+    "org.contikios.cooja.mspmote.interfaces.MspClock",
+    "org.contikios.cooja.mspmote.interfaces.MspMoteID",
+    "org.contikios.cooja.mspmote.interfaces.SkyButton",
+    "org.contikios.cooja.mspmote.interfaces.SkyFlash",
+    "org.contikios.cooja.mspmote.interfaces.SkyCoffeeFilesystem",
+    "org.contikios.cooja.mspmote.interfaces.Msp802154Radio",
+    "org.contikios.cooja.mspmote.interfaces.MspSerial",
+    "org.contikios.cooja.mspmote.interfaces.SkyLED",
+    "org.contikios.cooja.mspmote.interfaces.MspDebugOutput",
+    "org.contikios.cooja.mspmote.interfaces.SkyTemperature",
+]
+
+SCRIPT = """TIMEOUT({timeout}, log.testOK());
+while (true) {{
+  YIELD();
+  if (id == {cu} && msg.indexOf("STRESS") == 0) {{
+    log.log(time + " " + msg + "\\n");
+  }}
+  if (msg.indexOf("WAKES") == 0) {{
+    log.log(time + " " + id + " " + msg + "\\n");
+  }}
+}}"""
+
+
+def mote_type(ident, description, node, defines, srcdir):
+    # The node object is removed first since make doesn't see DEFINES changes,
+    # so are the objects depending on the MAC driver of LINK_IMPAIR and the
+    # wake counters of WAKE_COUNT
+    lines = ["    <motetype>",
+             "      org.contikios.cooja.mspmote.SkyMoteType",
+             "      <identifier>%s</identifier>" % ident,
+             "      <description>%s</description>" % description,
+             "      <source EXPORT=\"discard\">%s/%s.c</source>" % (srcdir, node),
+             "      <commands EXPORT=\"discard\">rm -f %s.co %s" % (node, IMPAIR_OBJECTS),
+             "make %s.sky TARGET=sky DEFINES=%s</commands>" % (node, defines),
+             "      <firmware EXPORT=\"copy\">%s/%s.sky</firmware>" % (srcdir, node)]
+    lines += ["      <moteinterface>%s</moteinterface>" % i for i in SKY_INTERFACES]
+    lines.append("    </motetype>")
+    return lines
+
+
+def mote(ident, addr, x, y):
+    return ["    <mote>",
+            "      <interface_config>",
+            "        org.contikios.cooja.interfaces.Position",
+            "        <x>%.2f</x>" % x,
+            "        <y>%.2f</y>" % y,
+            "        <z>0.0</z>",
+            "      </interface_config>",
+            "      <interface_config>",
+            "        org.contikios.cooja.mspmote.interfaces.MspMoteID",
+            "        <id>%d</id>" % addr,
+            "      </interface_config>",
+            "      <motetype_identifier>%s</motetype_identifier>" % ident,
+            "    </mote>"]
+
+
+def impair_defines(args):
+    values = [("IMPAIR_LOSS", args.loss or 0), ("IMPAIR_LATENCY", args.latency),
+              ("IMPAIR_JITTER", args.jitter), ("IMPAIR_DUP", args.dup),
+              ("IMPAIR_REORDER", args.reorder)]
+    # --loss 0 is given for the baseline of a loss sweep, its frame count
+    # comes from the impairment layer as well
+    if args.loss is None and not any(v for _, v in values):
+        return ""
+    defines = ["LINK_IMPAIR=1", "IMPAIR_MODEL=IMPAIR_%s" % args.model.upper(),
+               "IMPAIR_SEED=%d" % args.seed]
+    return "," + ",".join(defines + ["%s=%d" % (k, v) for k, v in values if v])
+
+
+def actuator_addrs(n):
+    return [a if a < CU_ADDR else a + 1 for a in range(1, n + 1)]
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("-n", "--nodes", type=int, default=2,
+                        help="number of actuators")
+    parser.add_argument("-d", "--density", type=float, default=10.0,
+                        help="actuators per 100x100 m")
+    parser.add_argument("-r", "--rate", type=int, default=2,
+                        help="requests per second issued by the CU")
+    parser.add_argument("-t", "--time", type=int, default=300,
+                        help="simulated seconds")
+    parser.add_argument("--range", type=float, default=50.0,
+                        help="UDGM transmission range, m")
+    parser.add_argument("-s", "--seed", type=int, default=123456)
+    parser.add_argument("--loss", type=int,
+                        help="frame loss, per mille (in the bad state for gilbert)")
+    parser.add_argument("--model", choices=["bernoulli", "gilbert"], default="bernoulli",
+                        help="loss model")
+    parser.add_argument("--latency", type=int, default=0, help="added latency, ms")
+    parser.add_argument("--jitter", type=int, default=0, help="added jitter, ms")
+    parser.add_argument("--dup", type=int, default=0, help="duplicated frames, per mille")
+    parser.add_argument("--reorder", type=int, default=0, help="reordered frames, per mille")
+    parser.add_argument("--wakes", action="store_true",
+                        help="count the process runs and callbacks of the nodes")
+    parser.add_argument("-o", "--output", default="-")
+    args = parser.parse_args()
+
+    if args.nodes < 1 or args.nodes > 250 or args.density <= 0 or args.rate < 1:
+        parser.error("invalid topology")
+    if not all(0 <= v <= 1000 for v in (args.loss or 0, args.dup, args.reorder)):
+        parser.error("probabilities are per mille")
+    impair = impair_defines(args)
+    if args.wakes:
+        impair += ",WAKE_COUNT=1"
+
+    # Square area centered on the CU holding the requested density
+    side = 100.0 * math.sqrt(args.nodes / args.density)
+    if side / math.sqrt(2) > args.range:
+        print("warning: some actuators may be out of the CU range", file=sys.stderr)
+
+    rnd = random.Random(args.seed)
+    out_dir = os.path.dirname(os.path.abspath(args.output)) if args.output != "-" else os.getcwd()
+    repo = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+    srcdir = "[CONFIG_DIR]/" + os.path.relpath(repo, out_dir)
+
+    xml = ["<?xml version=\"1.0\" encoding=\"UTF-8\"?>",
+           "<simconf>",
+           "  <simulation>",
+           "    <title>NESProject stress, %d actuators</title>" % args.nodes,
+           "    <randomseed>%d</randomseed>" % args.seed,
+           "    <motedelay_us>1000000</motedelay_us>",
+           "    <radiomedium>",
+           "      org.contikios.cooja.radiomediums.UDGM",
+           "      <transmitting_range>%.1f</transmitting_range>" % args.range,
+           "      <interference_range>%.1f</interference_range>" % (2 * args.range),
+           "      <success_ratio_tx>1.0</success_ratio_tx>",
+           "      <success_ratio_rx>1.0</success_ratio_rx>",
+           "    </radiomedium>",
+           "    <events>",
+           "      <logoutput>40000</logoutput>",
+           "    </events>"]
+    xml += mote_type("cu", "Central Unit", "CentralUnit",
+                     "CU_STRESS=1,CU_STRESS_RATE=%d,CU_STRESS_NODES=%d%s"
+                     % (args.rate, args.nodes, impair), srcdir)
+    xml += mote_type("door", "Door", "Door", "KEEP_NODE_ADDR=1" + impair, srcdir)
+    xml += mote_type("gate", "Gate", "Gate", "KEEP_NODE_ADDR=1" + impair, srcdir)
+    xml += mote("cu", CU_ADDR, 0.0, 0.0)
+    for addr in actuator_addrs(args.nodes):
+        xml += mote("door" if addr & 1 else "gate", addr,
+                    rnd.uniform(-side / 2, side / 2), rnd.uniform(-side / 2, side / 2))
+    xml += ["  </simulation>",
+            "  <plugin>",
+            "    org.contikios.cooja.plugins.ScriptRunner",
+            "    <plugin_config>",
+            "      <script>%s</script>" % SCRIPT.format(timeout=args.time * 1000, cu=CU_ADDR)
+                                               .replace("&", "&amp;").replace("<", "&lt;"),
+            "      <active>true</active>",
+            "    </plugin_config>",
+            "  </plugin>",
+            "</simconf>"]
+
+    text = "\n".join(xml) + "\n"
+    if args.output == "-":
+        sys.stdout.write(text)
+    else:
+        with open(args.output, "w") as f:
+            f.write(text)
+
+
+if __name__ == "__main__":
+    main()
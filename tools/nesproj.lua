@@ -0,0 +1,72 @@
+-- Wireshark dissector of the pcap files written by tools/trace2pcap.py:
+--   wireshark -X lua_script:tools/nesproj.lua trace.pcap
+-- then map USER0 to "nesproj" in the DLT_USER preferences if it isn't already
+
+local nesproj = Proto("nesproj", "NESProject radio trace")
+
+local channels = {[129] = "broadcast", [130] = "sync", [144] = "runicast", [146] = "ota"}
+local headers = {[0x00] = "CMD", [0x03] = "SYNC", [0x05] = "STATE", [0x0A] = "LIGHT",
+                 [0x0B] = "OTA", [0x0C] = "ALERT", [0x0D] = "HVAC", [0x0E] = "SCENE",
+                 [0x0F] = "TEMP", [0x10] = "PARAM"}
+local ota_types = {[0] = "BEGIN", [1] = "RESUME", [2] = "DATA", [3] = "DONE", [4] = "FAILED"}
+
+local f = nesproj.fields
+f.version = ProtoField.uint8("nesproj.version", "Version")
+f.dir = ProtoField.uint8("nesproj.dir", "Direction", base.DEC, {[0] = "received", [1] = "sent"})
+f.channel = ProtoField.uint16("nesproj.channel", "Channel", base.DEC, channels)
+f.src = ProtoField.string("nesproj.src", "Source")
+f.dst = ProtoField.string("nesproj.dst", "Destination")
+f.hdr = ProtoField.uint8("nesproj.hdr", "Header", base.HEX, headers)
+f.seq = ProtoField.uint8("nesproj.seq", "Seq")
+f.payload = ProtoField.uint16("nesproj.payload", "Payload", base.DEC_HEX)
+f.time = ProtoField.uint16("nesproj.time", "Time")
+f.group = ProtoField.uint8("nesproj.group", "Group", base.HEX)
+f.ota_type = ProtoField.uint8("nesproj.ota.type", "OTA type", base.DEC, ota_types)
+f.ota_offset = ProtoField.uint16("nesproj.ota.offset", "Offset")
+f.ota_size = ProtoField.uint16("nesproj.ota.size", "Size")
+f.ota_crc = ProtoField.uint16("nesproj.ota.crc", "CRC", base.HEX)
+f.ota_len = ProtoField.uint8("nesproj.ota.len", "Length")
+
+local function addr(tvb)
+    return string.format("%d.%d", tvb(0, 1):uint(), tvb(1, 1):uint())
+end
+
+function nesproj.dissector(tvb, pinfo, tree)
+    if tvb:len() < 8 then
+        return 0
+    end
+    local channel = tvb(2, 2):uint()
+    local src, dst = addr(tvb(4, 2)), addr(tvb(6, 2))
+    local t = tree:add(nesproj, tvb(), "NESProject")
+    t:add(f.version, tvb(0, 1))
+    t:add(f.dir, tvb(1, 1))
+    t:add(f.channel, tvb(2, 2))
+    t:add(f.src, tvb(4, 2), src)
+    t:add(f.dst, tvb(6, 2), dst)
+    pinfo.cols.protocol = "NESPROJ"
+    pinfo.cols.src = src
+    pinfo.cols.dst = dst == "0.0" and "broadcast" or dst
+
+    -- The nodes are MSP430s, the fields of the frames are little endian
+    local body = tvb(8)
+    if channel == 146 and body:len() >= 9 then
+        t:add(f.ota_type, body(1, 1))
+        t:add_le(f.ota_offset, body(2, 2))
+        t:add_le(f.ota_size, body(4, 2))
+        t:add_le(f.ota_crc, body(6, 2))
+        t:add(f.ota_len, body(8, 1))
+        pinfo.cols.info = "OTA " .. (ota_types[body(1, 1):uint()] or "?")
+    elseif body:len() >= 7 then
+        local hdr = body(0, 1):uint()
+        t:add(f.hdr, body(0, 1))
+        t:add(f.seq, body(1, 1))
+        t:add_le(f.payload, body(2, 2))
+        t:add_le(f.time, body(4, 2))
+        t:add(f.group, body(6, 1))
+        pinfo.cols.info = string.format("%s seq %d payload %d", headers[hdr] or "?",
+                                        body(1, 1):uint(), body(2, 2):le_uint())
+    end
+    return tvb:len()
+end
+
+DissectorTable.get("wtap_encap"):add(wtap.USER0, nesproj)
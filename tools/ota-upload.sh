@@ -0,0 +1,12 @@
+#!/bin/sh
+# Print the serial line commands storing a Contiki ELF module (make foo.ce) on
+# the Central Unit, e.g. tools/ota-upload.sh handler.ce > /dev/ttyUSB0
+# The module is then sent to a node writing "ota-send door" or "ota-send gate"
+
+if [ $# -ne 1 ]; then
+    echo "usage: $0 <module.ce>" >&2
+    exit 2
+fi
+
+echo "ota-clear"
+{ od -An -v -tx1 "$1" | tr -d ' \n' | fold -w 64; echo; } | sed '/^$/d; s/^/ota-data /'
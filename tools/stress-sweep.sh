@@ -0,0 +1,53 @@
+#!/bin/sh
+# Run the stress scenario headless in Cooja for a growing number of actuators
+# and print the last STRESS report of the CU for each of them.
+#
+# usage: stress-sweep.sh "2 8 16 32" [density] [rate] [seconds]
+#
+# With LOSSES set (per mille, e.g. LOSSES="0 50 100 200 300") every node count
+# is also run on an impaired link for each loss rate, IMPAIR holds further
+# gen-topology.py options (e.g. IMPAIR="--model gilbert --jitter 20"). The
+# output is then a table for gnuplot: nodes, loss, ok, lost, average and
+# maximum latency in ms and frames per delivered request. Loss 0 is built with
+# the impairment as well, the frames are counted there,
+#   gnuplot -e "plot 'sweep.dat' using 2:5 with linespoints"
+
+CONTIKI=${CONTIKI:-/home/user/contiki}
+COOJA_JAR=${COOJA_JAR:-$CONTIKI/tools/cooja/dist/cooja.jar}
+NODES=${1:-"2 8 16 32"}
+DENSITY=${2:-10}
+RATE=${3:-2}
+DURATION=${4:-300}
+TOOLS=$(dirname "$0")
+
+if [ -n "$LOSSES" ]; then
+    echo "# nodes loss ok lost avg_ms max_ms frames/ok"
+fi
+
+for n in $NODES; do
+    for loss in ${LOSSES:-none}; do
+        sim=stress-$n.csc
+        impair=""
+        if [ "$loss" != none ]; then
+            sim=stress-$n-loss-$loss.csc
+            impair="--loss $loss $IMPAIR"
+        fi
+        python3 "$TOOLS/gen-topology.py" -n "$n" -d "$DENSITY" -r "$RATE" -t "$DURATION" \
+            $impair -o "$sim" || exit 1
+        rm -f COOJA.testlog
+        java -mx512m -jar "$COOJA_JAR" -nogui="$sim" -contiki="$CONTIKI" > /dev/null 2>&1
+        report=$(grep STRESS COOJA.testlog 2>/dev/null | tail -n 1)
+        if [ "$loss" = none ]; then
+            echo "nodes=$n ${report:-no report}"
+        elif [ -n "$report" ]; then
+            # Fields of the report, after the simulation time Cooja logs
+            echo "$report" | awk -v n="$n" -v loss="$loss" '{
+                for (i = 1; i < NF; ++i) v[$i] = $(i + 1)
+                printf "%d %d %d %d %d %d %.2f\n", n, loss, v["ok"], v["lost"], v["avg"],
+                       v["max"], (v["ok"] > 0) ? v["frames"] / v["ok"] : 0
+            }'
+        else
+            echo "# nodes=$n loss=$loss no report"
+        fi
+    done
+done
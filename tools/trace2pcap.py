@@ -0,0 +1,99 @@
+#!/usr/bin/env python3
+"""Convert the radio trace of the nodes into a pcap file.
+
+Reads serial or Cooja logs holding the "#F" lines of nodes built with
+RADIO_TRACE=1 (see trace.h) and writes them, ordered by network time, as a
+pcap with link type USER0. The seconds of the nodes wrap after 18 hours, they
+are unwrapped along each log. Every packet starts with an 8 byte header, big endian:
+
+    version (1), direction (0 received, 1 sent), Rime channel (2),
+    source address (2), destination address (2, 0.0 for a broadcast)
+
+followed by the frame as the node saw it. tools/nesproj.lua dissects both in
+Wireshark (Edit > Preferences > Protocols > DLT_USER, USER0 -> nesproj).
+A frame sent by a node and received by another appears twice when both are
+captured, once sent and once received.
+
+    tools/trace2pcap.py -o trace.pcap cu.log door.log gate.log
+"""
+
+import argparse
+import re
+import struct
+import sys
+
+LINKTYPE_USER0 = 147
+HEADER_VERSION = 1
+
+FRAME = re.compile(r"#F (\d+) (\d+) ([rt]) (\d+) (\d+)\.(\d+) (\d+)\.(\d+) (\d+) ([0-9a-f]*)\s*$")
+DROPPED = re.compile(r"#F dropped (\d+)")
+WRAP_MS = 65536 * 1000
+
+
+def parse(path):
+    frames = []
+    # Last time and wraps of every node, a Cooja log holds all of them
+    last = {}
+    dropped = 0
+    with (sys.stdin if path == "-" else open(path)) as f:
+        for line in f:
+            m = DROPPED.search(line)
+            if m:
+                dropped += int(m.group(1))
+                continue
+            m = FRAME.search(line)
+            if not m:
+                continue
+            g = m.groups()
+            node = (int(g[4]) << 8) | int(g[5])
+            peer = (int(g[6]) << 8) | int(g[7])
+            sent = g[2] == "t"
+            time = int(g[0]) * 1000 + int(g[1])
+            prev, wraps = last.get(node, (time, 0))
+            if time < prev - WRAP_MS // 2:
+                wraps += 1
+            last[node] = (time, wraps)
+            frames.append({
+                "time": time + wraps * WRAP_MS,
+                "sent": sent,
+                "channel": int(g[3]),
+                "src": node if sent else peer,
+                "dst": peer if sent else node,
+                "len": int(g[8]),
+                "data": bytes.fromhex(g[9]),
+            })
+    if dropped:
+        print("%s: %d frames dropped by the nodes" % (path, dropped), file=sys.stderr)
+    return frames
+
+
+def write_pcap(out, frames):
+    out.write(struct.pack("<IHHiIII", 0xa1b2c3d4, 2, 4, 0, 0, 65535, LINKTYPE_USER0))
+    for fr in frames:
+        header = struct.pack(">BBHHH", HEADER_VERSION, 1 if fr["sent"] else 0,
+                             fr["channel"], fr["src"], fr["dst"])
+        packet = header + fr["data"]
+        seconds, ms = divmod(fr["time"], 1000)
+        out.write(struct.pack("<IIII", seconds, ms * 1000, len(packet),
+                              len(header) + fr["len"]))
+        out.write(packet)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("logs", nargs="*", default=["-"])
+    parser.add_argument("-o", "--output", required=True)
+    args = parser.parse_args()
+
+    frames = []
+    for path in args.logs:
+        frames += parse(path)
+    # Stable, so the frames of a node keep their order within a millisecond
+    frames.sort(key=lambda fr: fr["time"])
+    with open(args.output, "wb") as out:
+        write_pcap(out, frames)
+    print("%d frames" % len(frames), file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,94 @@
+#include "trace.h"
+
+#if RADIO_TRACE
+#include "net/packetbuf.h"
+#include "netsync.h"
+
+#if (TRACE_LEN & (TRACE_LEN - 1)) != 0 || TRACE_LEN > 128
+#error "TRACE_LEN must be a power of two up to 128"
+#endif
+
+struct trace_rec {
+    uint16_t seconds;
+    uint8_t ticks;
+    char dir;
+    uint16_t channel;
+    linkaddr_t peer;
+    uint8_t len;
+    uint8_t data[TRACE_MAX_LEN];
+};
+
+PROCESS(trace_process, "Radio Trace Flush");
+
+static struct trace_rec ring[TRACE_LEN];
+// Free running indexes, head - tail frames are waiting
+static uint8_t head = 0;
+static uint8_t tail = 0;
+static uint16_t dropped = 0;
+
+void trace_frame (char dir, uint16_t channel, const linkaddr_t* peer){
+    struct trace_rec* rec;
+    uint16_t len = packetbuf_datalen();
+
+    if ((uint8_t) (head - tail) == TRACE_LEN){
+        ++dropped;
+        return;
+    }
+    rec = &ring[head & (TRACE_LEN - 1)];
+    netsync_stamp(&rec->seconds, &rec->ticks);
+    rec->dir = dir;
+    rec->channel = channel;
+    linkaddr_copy(&rec->peer, peer);
+    // The length of the frame is printed whole, its bytes up to TRACE_MAX_LEN
+    rec->len = (uint8_t) len;
+    memcpy(rec->data, packetbuf_dataptr(), (len < TRACE_MAX_LEN) ? len : TRACE_MAX_LEN);
+    ++head;
+    process_poll(&trace_process);
+}
+
+static void trace_flush (uint8_t max){
+    const struct trace_rec* rec;
+    uint8_t i;
+
+    while (tail != head && max-- > 0){
+        rec = &ring[tail & (TRACE_LEN - 1)];
+        printf("#F %u %u %c %u %d.%d %d.%d %u ", rec->seconds,
+               (uint16_t) ((uint32_t) rec->ticks * 1000 / CLOCK_SECOND), rec->dir, rec->channel,
+               linkaddr_node_addr.u8[0], linkaddr_node_addr.u8[1],
+               rec->peer.u8[0], rec->peer.u8[1], rec->len);
+        for (i = 0; i < rec->len && i < TRACE_MAX_LEN; ++i){
+            printf("%02x", rec->data[i]);
+        }
+        printf("\n");
+        ++tail;
+    }
+    if (dropped > 0 && tail == head){
+        printf("#F dropped %u\n", dropped);
+        dropped = 0;
+    }
+}
+
+void trace_open (){
+    process_start(&trace_process, NULL);
+}
+
+PROCESS_THREAD(trace_process, ev, data){
+    static struct etimer idle_timer;
+    PROCESS_BEGIN();
+
+    while (true){
+        PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_POLL || ev == PROCESS_EVENT_TIMER);
+        // As binlog_process, the frames wait for the queued events
+        if (process_nevents() > 0){
+            etimer_set(&idle_timer, CLOCK_SECOND / 16);
+            continue;
+        }
+        trace_flush(TRACE_BURST);
+        if (tail != head){
+            process_poll(&trace_process);
+        }
+    }
+    PROCESS_END();
+    return 0;
+}
+#endif
@@ -0,0 +1,44 @@
+/**
+Radio trace capture. Built with RADIO_TRACE=1, the Rime send and receive paths
+of the nodes copy every frame to a RAM ring, before any filtering, so
+duplicates and frames for other groups are captured too. trace_process prints
+them on the serial line when no other event is waiting, as
+"#F <seconds> <ms> <r|t> <channel> <node> <peer> <length> <hex bytes>", the
+time being network time (netsync.h) so the logs of the nodes line up.
+tools/trace2pcap.py turns the lines of one or more nodes into a pcap file and
+bench/replay feeds them back to the host build of the node logic
+**/
+#ifndef TRACE_H_
+#define TRACE_H_  1
+
+#include "nesproj.h"
+
+#ifndef RADIO_TRACE
+#define RADIO_TRACE 0
+#endif
+
+// Bytes of a frame kept, an OTA chunk included
+#define TRACE_MAX_LEN   48
+
+// Frames in the ring, a power of two. The ring keeps the oldest frames when
+// it fills, the number of lost ones is printed once there is room
+#ifndef TRACE_LEN
+#define TRACE_LEN   8
+#endif
+
+// Frames printed for every idle poll
+#define TRACE_BURST 2
+
+#if RADIO_TRACE
+void trace_open (void);
+// Copies the frame in packetbuf, peer is linkaddr_null for a broadcast
+void trace_frame (char dir, uint16_t channel, const linkaddr_t* peer);
+#define TRACE_OPEN()            trace_open()
+#define TRACE_RX(channel, from) trace_frame('r', (channel), (from))
+#define TRACE_TX(channel, to)   trace_frame('t', (channel), (to))
+#else
+#define TRACE_OPEN()
+#define TRACE_RX(channel, from)
+#define TRACE_TX(channel, to)
+#endif
+#endif
@@ -0,0 +1,79 @@
+#include "wakes.h"
+
+#if WAKE_COUNT
+#include "sys/ctimer.h"
+
+// Counts of the current period. 16 bits are incremented with one instruction
+// on the MSP430, the polls of the clock interrupt don't garble them
+uint16_t wake_callbacks = 0;
+static uint16_t process_runs = 0;
+static uint16_t timer_wakes = 0;
+static int max_events = 0;
+
+static struct ctimer report_timer;
+
+// The originals of process.c, reached through the linker
+int __real_process_post (struct process* p, process_event_t ev, process_data_t data);
+void __real_process_post_synch (struct process* p, process_event_t ev, process_data_t data);
+void __real_process_poll (struct process* p);
+
+static void wake_event (struct process* p, process_event_t ev){
+    struct process* q;
+
+    if (p == PROCESS_BROADCAST){
+        for (q = process_list; q != NULL; q = q->next){
+            ++process_runs;
+        }
+    }
+    else {
+        ++process_runs;
+    }
+    if (ev == PROCESS_EVENT_TIMER){
+        ++timer_wakes;
+    }
+}
+
+int __wrap_process_post (struct process* p, process_event_t ev, process_data_t data){
+    int ret = __real_process_post(p, ev, data);
+    int queued;
+
+    if (ret == PROCESS_ERR_OK){
+        wake_event(p, ev);
+        queued = process_nevents();
+        if (queued > max_events){
+            max_events = queued;
+        }
+    }
+    return ret;
+}
+
+void __wrap_process_post_synch (struct process* p, process_event_t ev, process_data_t data){
+    wake_event(p, ev);
+    __real_process_post_synch(p, ev, data);
+}
+
+void __wrap_process_poll (struct process* p){
+    if (p != NULL){
+        ++process_runs;
+        if (p == &etimer_process){
+            ++timer_wakes;
+        }
+    }
+    __real_process_poll(p);
+}
+
+// Not counted as a callback, it would show up in every report
+static void wake_report (void* ptr){
+    printf("WAKES %lu %u %u %u %d\n", clock_seconds(), process_runs, timer_wakes,
+           wake_callbacks, max_events);
+    process_runs = 0;
+    timer_wakes = 0;
+    wake_callbacks = 0;
+    max_events = 0;
+    ctimer_reset(&report_timer);
+}
+
+void wake_open (){
+    ctimer_set(&report_timer, WAKE_REPORT_PERIOD, wake_report, NULL);
+}
+#endif
@@ -0,0 +1,34 @@
+/**
+Wake counters, built with WAKE_COUNT=1. The Makefile links the node with the
+process_post(), process_post_synch() and process_poll() calls of the other
+objects wrapped (ld --wrap), so wakes.c sees every event and poll on its way
+to a process, Contiki's timer processes included, without touching them: a
+run for an event to a process or a poll, one for every process for a
+broadcast. WAKE_CALLBACK() goes at the top of the ctimer callbacks. Every
+WAKE_REPORT_PERIOD the node prints "WAKES <seconds> <process runs> <timer
+wakes> <callbacks> <max queued events>" for the period, the timer wakes being
+the timer events and the polls of etimer_process, the queue peak sampled after
+every post. A poll of a process already polled is counted again, so the runs
+are an upper bound. Nothing of the node is needed but the wake_open() call,
+so the same files measure an older build for a comparison
+**/
+#ifndef WAKES_H_
+#define WAKES_H_  1
+
+#include "nesproj.h"
+
+#ifndef WAKE_COUNT
+#define WAKE_COUNT  0
+#endif
+
+#define WAKE_REPORT_PERIOD  (CLOCK_SECOND * 60)
+
+#if WAKE_COUNT
+extern uint16_t wake_callbacks;
+#define WAKE_CALLBACK() (++wake_callbacks)
+void wake_open (void);
+#else
+#define WAKE_CALLBACK()
+#define wake_open()
+#endif
+#endif